@@ -3,20 +3,32 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <chrono>
+#include <set>
 #include "utils/thirdparty/quiche/rtt_stats.h"
 #include "basefw/base/log.h"
 #include "utils/rttstats.h"
 #include "utils/transporttime.h"
-#include "utils/defaultclock.hpp"
 #include "packettype.h"
+#include "utils/deliveryratesampler.hpp"
+#include "utils/windowedfilter.hpp"
 
 enum class CongestionCtlType : uint8_t
 {
     none = 0,
     reno = 1,
-    cubic = 2
+    cubic = 2,
+    bbr = 3,
+    coupled = 4,/** the sessions of a task share a CoupledWindowCoordinator*/
+    copa = 5
+};
+
+enum class LossDetectionType : uint8_t
+{
+    rto = 0,/** DefaultLossDetectionAlgo, check timeout on alarm*/
+    ackbased = 1/** AckBasedLossDetectionAlgo, packet and time threshold on each ack*/
 };
 
 struct LossEvent
@@ -25,6 +37,7 @@ struct LossEvent
     // There may be multiple timeout events at one time
     std::vector<InflightPacket> lossPackets;
     Timepoint losttic{ Timepoint::Infinite() };
+    uint32_t priorInflight{ 0 };/** pieces in flight on the session, the lost ones included*/
 
     std::string DebugInfo() const
     {
@@ -50,6 +63,10 @@ struct AckEvent
     Timepoint sendtic{ Timepoint::Infinite() };
 //    Timepoint losttic{ Timepoint::Infinite() };
     Timepoint recvstic{ Timepoint::Infinite() };
+    uint64_t delivered{ 0 };/** bytes delivered on the session, this packet included*/
+    DeliveryState sentState;/** delivery state of the session when this packet was sent*/
+    RateSample rateSample;/** delivery rate measured by this ack*/
+    uint32_t inflight{ 0 };/** pieces still in flight on the session, without this one and the ones found lost*/
 
     std::string DebugInfo() const
     {
@@ -60,7 +77,9 @@ struct AckEvent
            << "dataid: " << ackPacket.pieceId << " "
            << "} "
            << "sendtic: " << sendtic.ToDebuggingValue() << " "
-           << "recvstic: " << recvstic.ToDebuggingValue() << " ";
+           << "recvstic: " << recvstic.ToDebuggingValue() << " "
+           << "delivered: " << delivered << " "
+           << "priordelivered: " << sentState.delivered << " ";
         return ss.str();
     }
 };
@@ -87,6 +106,19 @@ public:
     {
     };
 
+    /// @return true if DetectLoss should be called on every ack, not only when the loss timer expires
+    virtual bool DetectOnAck() const
+    {
+        return false;
+    }
+
+    /// @return the earliest time that a packet in flight may be declared lost, set by the last DetectLoss call.
+    /// Zero means check on every alarm.
+    virtual Timepoint GetLossTimer() const
+    {
+        return Timepoint::Zero();
+    }
+
     virtual ~LossDetectionAlgo() = default;
 
 };
@@ -110,14 +142,15 @@ public:
         Duration loss_delay = maxrtt + (maxrtt * (5.0 / 4.0));
         loss_delay = std::max(loss_delay, Duration::FromMicroseconds(1));
         SPDLOG_TRACE(" maxrtt: {}, loss_delay: {}", maxrtt.ToDebuggingValue(), loss_delay.ToDebuggingValue());
-        for (const auto& pkt_itor: downloadingmap.inflightPktMap)
-        {
-            const auto& pkt = pkt_itor.second;
+        // packets are sent in sequence order, stop at the first one that hasn't timed out
+        downloadingmap.ForEachFromOldest([&](const InflightEntry& pkt) {
             if (Timepoint(pkt.sendtic + loss_delay) <= eventtime)
             {
-                losses.lossPackets.emplace_back(pkt);
+                losses.lossPackets.emplace_back(pkt.ToInflightPacket());
+                return true;
             }
-        }
+            return false;
+        });
         if (!losses.lossPackets.empty())
         {
             losses.losttic = eventtime;
@@ -134,6 +167,84 @@ private:
 };
 
 
+/// RFC 9002 Section 6.1 style loss detection, run on every ack.
+/// A packet sent before the largest acked one is lost if kPacketThreshold later packets have been acked,
+/// or it was sent 9/8 RTT before. Packets without a later ack fall back to the timeout of DefaultLossDetectionAlgo.
+/// The loss timer tells when the oldest packet in flight will cross the next threshold.
+class AckBasedLossDetectionAlgo : public LossDetectionAlgo
+{
+public:
+    static constexpr SeqNumber kPacketThreshold = 3;
+
+    void DetectLoss(const InFlightPacketMap& downloadingmap, Timepoint eventtime, const AckEvent& ackEvent,
+            uint64_t maxacked, LossEvent& losses, RttStats& rttStats) override
+    {
+        SPDLOG_TRACE("eventtime: {} ackEvent:{} maxacked: {}", eventtime.ToDebuggingValue(), ackEvent.DebugInfo(),
+                maxacked);
+        Duration maxrtt = std::max(rttStats.smoothed_rtt(), rttStats.latest_rtt());
+        if (maxrtt == Duration::Zero())
+        {
+            maxrtt = rttStats.SmoothedOrInitialRtt();
+        }
+        Duration time_threshold = std::max(maxrtt * (9.0 / 8.0), Duration::FromMilliseconds(1));
+        Duration timeout_delay = std::max(maxrtt + (maxrtt * (5.0 / 4.0)), Duration::FromMicroseconds(1));
+        bool hasAcked = maxacked < MAX_SEQNUMBER;
+        SeqNumber largestAcked = hasAcked ? static_cast<SeqNumber>(maxacked) : 0;
+
+        m_lossTimer = Timepoint::Infinite();
+        // packets are sent in sequence order, so the first packet which isn't lost ends the scan
+        downloadingmap.ForEachFromOldest([&](const InflightEntry& pkt) {
+            if (hasAcked && pkt.seq < largestAcked)
+            {
+                if (largestAcked - pkt.seq >= kPacketThreshold || Timepoint(pkt.sendtic + time_threshold) <= eventtime)
+                {
+                    losses.lossPackets.emplace_back(pkt.ToInflightPacket());
+                    return true;
+                }
+                m_lossTimer = pkt.sendtic + time_threshold;
+            }
+            if (Timepoint(pkt.sendtic + timeout_delay) <= eventtime)
+            {
+                losses.lossPackets.emplace_back(pkt.ToInflightPacket());
+                return true;
+            }
+            m_lossTimer = std::min(m_lossTimer, pkt.sendtic + timeout_delay);
+            return false;
+        });
+        if (m_lossTimer == Timepoint::Infinite())
+        {
+            // nothing left in flight, let the next alarm arm the timer for packets sent from now on
+            m_lossTimer = Timepoint::Zero();
+        }
+
+        if (!losses.lossPackets.empty())
+        {
+            losses.losttic = eventtime;
+            losses.valid = true;
+            SPDLOG_DEBUG("losses: {}", losses.DebugInfo());
+        }
+        SPDLOG_TRACE("loss timer: {}", m_lossTimer.ToDebuggingValue());
+    }
+
+    bool DetectOnAck() const override
+    {
+        return true;
+    }
+
+    Timepoint GetLossTimer() const override
+    {
+        return m_lossTimer;
+    }
+
+    ~AckBasedLossDetectionAlgo() override
+    {
+    }
+
+private:
+    Timepoint m_lossTimer{ Timepoint::Zero() };
+};
+
+
 class CongestionCtlAlgo
 {
 public:
@@ -147,6 +258,21 @@ public:
 
     virtual void OnDataAckOrLoss(const AckEvent& ackEvent, const LossEvent& lossEvent, RttStats& rttstats) = 0;
 
+    /// the packet is no longer waited for, it will be neither acked nor lost
+    virtual void OnDataCancelled(const InflightPacket& cancelledpkt)
+    {
+    }
+
+    /// a packet reported lost has been answered after all, the window reduction it caused may be undone
+    virtual void OnSpuriousLoss(const InflightPacket& lostpkt)
+    {
+    }
+
+    /// the session has been found to share a bottleneck with the other groupSize - 1 sessions of this group
+    virtual void OnBottleneckGroup(uint32_t group, uint32_t groupSize)
+    {
+    }
+
     /////
     virtual uint32_t GetCWND() = 0;
 
@@ -156,6 +282,169 @@ public:
 
     virtual bool InSlowStart() = 0;
 
+    /// @return true while the window reduced on a loss is taking effect, the sender then slows down gradually
+    virtual bool InRecovery()
+    {
+        return false;
+    }
+
+    /// @return pacing rate in bytes per second, 0 to let the sender derive it from cwnd and srtt
+    virtual uint64_t GetPacingRate()
+    {
+        return 0;
+    }
+
+};
+
+/// LossUndoState remembers the window before the last loss reduction, after Eifel.
+/// If every packet of the loss event which caused the reduction turns out to have been answered late, the losses were
+/// spurious and the window is restored.
+struct LossUndoState
+{
+    uint32_t priorCwnd{ 0 };
+    uint32_t priorSsThresh{ 0 };
+    std::set<SeqNumber> lostSeqs;/** packets of the loss event not answered yet*/
+
+    /// the window is about to be reduced on lossEvent, a reduction replaces the previous one
+    void OnReduction(uint32_t cwnd, uint32_t ssThresh, const LossEvent& lossEvent)
+    {
+        priorCwnd = cwnd;
+        priorSsThresh = ssThresh;
+        lostSeqs.clear();
+        for (auto&& pkt: lossEvent.lossPackets)
+        {
+            lostSeqs.insert(pkt.seq);
+        }
+    }
+
+    /// @return true if the last packet of the loss event has been answered late, so the reduction should be undone
+    bool OnSpuriousLoss(const InflightPacket& lostpkt)
+    {
+        if (lostSeqs.erase(lostpkt.seq) == 0 || !lostSeqs.empty())
+        {
+            return false;
+        }
+        SPDLOG_DEBUG("spurious loss, undo to cwnd:{}, ssthresh:{}", priorCwnd, priorSsThresh);
+        return true;
+    }
+};
+
+/// RecoveryState tells if a session is in loss recovery, after RFC 6582.
+/// A loss of a packet sent after the last window reduction starts recovery, which ends when a packet sent after
+/// that has been answered. The other packets in flight at the reduction were sent with the old window, losing
+/// them as well doesn't reduce the window again, even if they are found lost after recovery has ended.
+struct RecoveryState
+{
+    bool inRecovery{ false };
+    bool reduced{ false };/** the window has been reduced once at least, recoveryPoint is valid*/
+    SeqNumber largestSentSeq{ 0 };
+    SeqNumber recoveryPoint{ 0 };/** the largest seq sent at the last window reduction*/
+
+    void OnDataSent(const InflightPacket& sentpkt)
+    {
+        largestSentSeq = std::max(largestSentSeq, sentpkt.seq);
+    }
+
+    /// @return true if the window should be reduced on lossEvent, recovery starts then
+    bool OnLoss(const LossEvent& lossEvent)
+    {
+        bool newLoss = !reduced || std::any_of(lossEvent.lossPackets.begin(), lossEvent.lossPackets.end(),
+                [this](const InflightPacket& pkt) { return pkt.seq > recoveryPoint; });
+        if (!newLoss)
+        {
+            SPDLOG_DEBUG("loss of packets sent before seq:{}, no further reduction", recoveryPoint);
+            return false;
+        }
+        inRecovery = true;
+        reduced = true;
+        recoveryPoint = largestSentSeq;
+        return true;
+    }
+
+    void OnAck(const AckEvent& ackEvent)
+    {
+        if (inRecovery && ackEvent.ackPacket.seq > recoveryPoint)
+        {
+            SPDLOG_DEBUG("seq:{} answered, recovery ends", ackEvent.ackPacket.seq);
+            inRecovery = false;
+        }
+    }
+
+    /// the reduction has been undone
+    void Exit()
+    {
+        inRecovery = false;
+    }
+};
+
+/// config of the loss differentiation, off by default as the congestion controllers are loss based
+struct LossDifferentiationConfig
+{
+    bool enabled{ false };
+    double queueThresh{ 0.3 };/** a queue is building if the rtt is above min rtt + queueThresh * (max rtt - min rtt)*/
+    Duration minQueueDelay{ Duration::FromMilliseconds(5) };/** ... and at least so much above the min rtt*/
+    Duration maxRttWindow{ Duration::FromSeconds(10) };
+    uint32_t burstLossCnt{ 2 };/** a loss event with so many packets is a burst*/
+    double clusterRtts{ 1.0 };/** a loss within so many srtt of the previous one belongs to the same cluster*/
+};
+
+/// LossDifferentiator tells random losses, e.g. on a wireless link, from congestion losses, after Spike and
+/// the loss clustering of ZigZag. A loss is a congestion loss if a queue is building, the latest rtt being well
+/// above the min rtt compared to the rtt range seen lately, or if it comes in a burst or in a cluster with the
+/// previous loss. An isolated loss without a queue is random: the pieces are requested again, but the congestion
+/// controller doesn't see the loss, so the window isn't cut.
+class LossDifferentiator
+{
+public:
+    explicit LossDifferentiator(const LossDifferentiationConfig& config = LossDifferentiationConfig())
+            : m_config(config), m_maxRttFilter(config.maxRttWindow.ToMicroseconds(), 0)
+    {
+    }
+
+    void OnRttSample(Duration rtt, Timepoint now)
+    {
+        m_maxRttFilter.Update(rtt.ToMicroseconds(), (now - Timepoint::Zero()).ToMicroseconds());
+    }
+
+    /// @return true if the congestion controller should not react to lossEvent
+    bool IsRandomLoss(const LossEvent& lossEvent, const RttStats& rttstats)
+    {
+        if (!m_config.enabled || !lossEvent.valid)
+        {
+            return false;
+        }
+        Duration srtt = rttstats.SmoothedOrInitialRtt();
+        bool clustered = lossEvent.lossPackets.size() >= m_config.burstLossCnt ||
+                (m_lastLossTic.IsInitialized() && lossEvent.losttic - m_lastLossTic < srtt * m_config.clusterRtts);
+        m_lastLossTic = lossEvent.losttic;
+
+        // without a min rtt there is nothing to compare to, take it as congestion
+        int64_t minRttUs = rttstats.min_rtt().ToMicroseconds();
+        int64_t latestRttUs = rttstats.latest_rtt().ToMicroseconds();
+        int64_t queueUs = latestRttUs - minRttUs;
+        int64_t rangeUs = m_maxRttFilter.GetBest() - minRttUs;
+        bool queued = minRttUs == 0 ||
+                (queueUs > m_config.minQueueDelay.ToMicroseconds() && queueUs > m_config.queueThresh * rangeUs);
+        if (clustered || queued)
+        {
+            return false;
+        }
+        m_randomLossCnt += lossEvent.lossPackets.size();
+        SPDLOG_DEBUG("random loss:{}, latest rtt:{} us, min rtt:{} us, max rtt:{} us, random losses so far:{}",
+                lossEvent.DebugInfo(), latestRttUs, minRttUs, m_maxRttFilter.GetBest(), m_randomLossCnt);
+        return true;
+    }
+
+    uint64_t GetRandomLossCnt() const
+    {
+        return m_randomLossCnt;
+    }
+
+private:
+    LossDifferentiationConfig m_config;
+    WindowedFilter<int64_t, MaxFilter<int64_t>> m_maxRttFilter;/** us, windowed by time*/
+    Timepoint m_lastLossTic{ Timepoint::Zero() };
+    uint64_t m_randomLossCnt{ 0 };
 };
 
 /// config or setting for specific cc algo
@@ -192,18 +481,20 @@ public:
     void OnDataSent(const InflightPacket& sentpkt) override
     {
         SPDLOG_TRACE("");
+        m_recovery.OnDataSent(sentpkt);
     }
 
     void OnDataAckOrLoss(const AckEvent& ackEvent, const LossEvent& lossEvent, RttStats& rttstats) override
     {
         SPDLOG_TRACE("ackevent:{}, lossevent:{}", ackEvent.DebugInfo(), lossEvent.DebugInfo());
-        if (lossEvent.valid)
+        if (lossEvent.valid && m_recovery.OnLoss(lossEvent))
         {
             OnDataLoss(lossEvent);
         }
 
         if (ackEvent.valid)
         {
+            m_recovery.OnAck(ackEvent);
             OnDataRecv(ackEvent);
         }
 
@@ -236,27 +527,19 @@ public:
         return rt;
     }
 
-    bool LostCheckRecovery(Timepoint largestLostSentTic)
+    void OnSpuriousLoss(const InflightPacket& lostpkt) override
     {
-        SPDLOG_DEBUG("largestLostSentTic:{},lastLagestLossPktSentTic:{}",
-                largestLostSentTic.ToDebuggingValue(), lastLagestLossPktSentTic.ToDebuggingValue());
-        /** If the largest sent tic of this loss event,is bigger than the last sent tic of the last lost pkt
-         * (plus a 10ms correction), this session is in Recovery phase.
-         * */
-        if (lastLagestLossPktSentTic.IsInitialized() &&
-            (largestLostSentTic + Duration::FromMilliseconds(10) > lastLagestLossPktSentTic))
+        if (m_lossUndo.OnSpuriousLoss(lostpkt))
         {
-            SPDLOG_DEBUG("In Recovery");
-            return true;
-        }
-        else
-        {
-            // a new timelost
-            lastLagestLossPktSentTic = largestLostSentTic;
-            SPDLOG_DEBUG("new loss");
-            return false;
+            m_cwnd = BoundCwnd(std::max(m_cwnd, m_lossUndo.priorCwnd));
+            m_ssThresh = std::max(m_ssThresh, m_lossUndo.priorSsThresh);
+            m_recovery.Exit();
         }
+    }
 
+    bool InRecovery() override
+    {
+        return m_recovery.inRecovery;
     }
 
 private:
@@ -304,15 +587,10 @@ private:
     void OnDataLoss(const LossEvent& lossEvent)
     {
         SPDLOG_DEBUG("lossevent:{}", lossEvent.DebugInfo());
-        Timepoint maxsentTic{ Timepoint::Zero() };
+        m_lossUndo.OnReduction(m_cwnd, m_ssThresh, lossEvent);
 
-        for (const auto& lostpkt: lossEvent.lossPackets)
-        {
-            maxsentTic = std::max(maxsentTic, lostpkt.sendtic);
-        }
-
-        /** In Recovery phase, cwnd will decrease 1 pkt for each lost pkt
-         *  Otherwise, cwnd will cut half.
+        /** Called once per recovery episode, cwnd will cut half.
+         *  The sender spreads the reduction over the recovery with PRR.
          * */
         if (InSlowStart())
         {
@@ -321,14 +599,12 @@ private:
             m_cwnd = BoundCwnd(m_cwnd);
 
         }
-        else //if (!LostCheckRecovery(maxsentTic))
+        else
         {
-            // Not In slow start and not inside Recovery state
-            // Cut half
+            // Not In slow start, cut half
             m_cwnd = m_cwnd / 2;
             m_cwnd = BoundCwnd(m_cwnd);
             m_ssThresh = m_cwnd;
-            // enter Recovery state
         }
         SPDLOG_DEBUG("after Loss, m_cwnd={}", m_cwnd);
     }
@@ -341,10 +617,11 @@ private:
 
     uint32_t m_cwnd{ 1 };
     uint32_t m_cwndCnt{ 0 }; /** in congestion avoid phase, used for counting ack packets*/
-    Timepoint lastLagestLossPktSentTic{ Timepoint::Zero() };
+    RecoveryState m_recovery;
 
 
     uint32_t m_minCwnd{ 1 };
     uint32_t m_maxCwnd{ 64 };
     uint32_t m_ssThresh{ 32 };/** slow start threshold*/
+    LossUndoState m_lossUndo;
 };
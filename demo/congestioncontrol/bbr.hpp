@@ -0,0 +1,323 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include "demo/congestioncontrol.hpp"
+
+struct BbrCongestionCtlConfig {
+    uint32_t minCwnd{ 4 };
+    uint32_t maxCwnd{ 256 };
+    uint32_t initCwnd{ 10 };
+    Duration minRttWindow{ Duration::FromSeconds(10) };/** enter ProbeRTT if min rtt isn't refreshed for so long*/
+    Duration probeRttTime{ Duration::FromMilliseconds(200) };/** time to stay in ProbeRTT*/
+    double lossThresh{ 0.02 };/** a round losing more than this share of its pieces bounds the pieces in flight*/
+    double lossBeta{ 0.7 };/** the bound is this share of the pieces in flight when the loss rate got too high*/
+};
+
+enum class BbrMode : uint8_t {
+    startup = 0,
+    drain = 1,
+    probe_bw = 2,
+    probe_rtt = 3
+};
+
+/// BBR v1 congestion control, counting in data pieces.
+/// The bottleneck bandwidth is the max delivery rate of the session's DeliveryRateSampler, the propagation delay is
+/// the windowed min rtt. The pieces in flight are the session's, as carried by the ack and loss events.
+/// cwnd is cwnd gain * BDP and the pacing rate is pacing gain * bandwidth, the pacing gain cycles through 1.25, 0.75
+/// and 1 in ProbeBW. The transport controllers always pace it.
+/// Losses beyond lossThresh in a round bound the pieces in flight like inflight_hi of BBRv2, which ends Startup and
+/// keeps a shallow queue from overflowing. The bound is probed up again from the next round on, doubling each round.
+class BbrCongestionContrl : public CongestionCtlAlgo {
+public:
+
+    explicit BbrCongestionContrl(const BbrCongestionCtlConfig &ccConfig)
+            : m_config(ccConfig), m_cwnd(ccConfig.initCwnd) {
+        m_cwnd = BoundCwnd(m_cwnd);
+        SPDLOG_DEBUG("minCwnd:{}, maxCwnd:{}, initCwnd:{}", m_config.minCwnd, m_config.maxCwnd, m_config.initCwnd);
+    }
+
+    ~BbrCongestionContrl() override {
+        SPDLOG_DEBUG("");
+    }
+
+    CongestionCtlType GetCCtype() override {
+        return CongestionCtlType::bbr;
+    }
+
+    void OnDataSent(const InflightPacket &sentpkt) override {
+        SPDLOG_TRACE("");
+    }
+
+    void OnDataAckOrLoss(const AckEvent &ackEvent, const LossEvent &lossEvent, RttStats &rttstats) override {
+        SPDLOG_TRACE("ackevent:{}, lossevent:{}", ackEvent.DebugInfo(), lossEvent.DebugInfo());
+        if (lossEvent.valid) {
+            OnDataLoss(lossEvent);
+        }
+        if (!ackEvent.valid) {
+            return;
+        }
+
+        Timepoint now = ackEvent.recvstic;
+        UpdateRound(ackEvent);
+        ++m_roundAcked;
+        UpdateBandwidth(ackEvent);
+        CheckFullBandwidth();
+        CheckDrain(ackEvent.inflight, now);
+        UpdateGainCycle(ackEvent.inflight, now);
+        UpdateMinRtt(ackEvent, now);
+        SetCwnd(ackEvent);
+        SPDLOG_DEBUG("mode:{}, maxbw:{}, minrtt:{}, cwnd:{}, inflight:{}", static_cast<int>(m_mode), m_maxBw,
+                     m_minRtt.ToDebuggingValue(), m_cwnd, ackEvent.inflight);
+    }
+
+    uint32_t GetCWND() override {
+        return m_cwnd;
+    }
+
+    void UpdateState() override {
+        // the state machine runs on acks
+    }
+
+    bool InSlowStart() override {
+        return m_mode == BbrMode::startup;
+    }
+
+    uint64_t GetPacingRate() override {
+        return static_cast<uint64_t>(m_pacingGain * m_maxBw);
+    }
+
+    BbrMode GetMode() const {
+        return m_mode;
+    }
+
+private:
+    static constexpr double kHighGain = 2.885;/** 2/ln(2), doubles the sending rate each round in Startup*/
+    static constexpr double kDrainGain = 1.0 / 2.885;
+    static constexpr double kCwndGain = 2.0;
+    static constexpr uint32_t kGainCycleLength = 8;/** ProbeBW pacing gains are 1.25, 0.75, then 1 for 6 phases*/
+    static constexpr double kFullBwThresh = 1.25;/** bandwidth has to grow this much in a round in Startup*/
+    static constexpr uint32_t kFullBwRounds = 3;
+
+    /// the round trips are the ones of the delivery rate sampler
+    void UpdateRound(const AckEvent &ackEvent) {
+        m_roundStart = ackEvent.rateSample.roundStart;
+        if (m_roundStart) {
+            m_roundCount = ackEvent.rateSample.roundCount;
+            ProbeInflightBound();
+            m_roundAcked = 0;
+            m_roundLost = 0;
+            m_lossBoundInRound = false;
+        }
+    }
+
+    /// bound the pieces in flight once per round if the round has lost too much, and probe the bound up otherwise
+    void OnDataLoss(const LossEvent &lossEvent) {
+        m_roundLost += lossEvent.lossPackets.size();
+        if (m_lossBoundInRound || m_roundLost <= m_config.lossThresh * (m_roundAcked + m_roundLost)) {
+            return;
+        }
+        m_lossBoundInRound = true;
+        m_inflightHi = std::max(m_config.minCwnd, static_cast<uint32_t>(lossEvent.priorInflight * m_config.lossBeta));
+        m_inflightHiGrowth = 1;
+        m_cwnd = std::min(m_cwnd, m_inflightHi);
+        if (!m_fullBwReached) {
+            m_fullBwReached = true;
+            SPDLOG_DEBUG("loss in startup, full bandwidth reached: {}", m_maxBw);
+        }
+        SPDLOG_DEBUG("lost:{} of {} in round, inflight bound:{}", m_roundLost, m_roundAcked + m_roundLost,
+                     m_inflightHi);
+    }
+
+    void ProbeInflightBound() {
+        if (m_inflightHi == 0 || m_lossBoundInRound) {
+            return;
+        }
+        if (m_cwnd >= m_inflightHi) {
+            m_inflightHi += m_inflightHiGrowth;
+            m_inflightHiGrowth *= 2;
+        }
+        if (m_inflightHi >= m_config.maxCwnd) {
+            m_inflightHi = 0;
+        }
+    }
+
+    /// the sampler has already filtered out the app-limited samples below the estimate
+    void UpdateBandwidth(const AckEvent &ackEvent) {
+        const RateSample &rs = ackEvent.rateSample;
+        m_maxBw = rs.maxDeliveryRate;
+        SPDLOG_TRACE("bw sample:{} bytes/s, app limited:{}, max:{}", rs.deliveryRate, rs.isAppLimited, m_maxBw);
+    }
+
+    /// Startup ends when the bandwidth stops growing by 25% for kFullBwRounds rounds
+    void CheckFullBandwidth() {
+        if (m_fullBwReached || !m_roundStart) {
+            return;
+        }
+        if (m_maxBw >= m_fullBw * kFullBwThresh) {
+            m_fullBw = m_maxBw;
+            m_fullBwCnt = 0;
+            return;
+        }
+        if (++m_fullBwCnt >= kFullBwRounds) {
+            m_fullBwReached = true;
+            SPDLOG_DEBUG("full bandwidth reached: {}", m_fullBw);
+        }
+    }
+
+    void CheckDrain(uint32_t inflight, Timepoint now) {
+        if (m_mode == BbrMode::startup && m_fullBwReached) {
+            m_mode = BbrMode::drain;
+            m_pacingGain = kDrainGain;
+            m_cwndGain = kHighGain;
+        }
+        if (m_mode == BbrMode::drain && inflight <= Bdp(1.0)) {
+            EnterProbeBw(now);
+        }
+    }
+
+    void EnterStartup() {
+        m_mode = BbrMode::startup;
+        m_pacingGain = kHighGain;
+        m_cwndGain = kHighGain;
+    }
+
+    void EnterProbeBw(Timepoint now) {
+        m_mode = BbrMode::probe_bw;
+        m_cwndGain = kCwndGain;
+        // start from a phase other than the 0.75 one, varied between sessions by the round count
+        m_cycleIndex = kGainCycleLength - 1 - (m_roundCount % (kGainCycleLength - 1));
+        AdvanceCyclePhase(now);
+    }
+
+    void AdvanceCyclePhase(Timepoint now) {
+        m_cycleIndex = (m_cycleIndex + 1) % kGainCycleLength;
+        m_cycleStamp = now;
+        m_pacingGain = m_cycleIndex == 0 ? 1.25 : (m_cycleIndex == 1 ? 0.75 : 1.0);
+    }
+
+    /// each phase lasts one min rtt, probing up until the pipe is full and draining until the queue is gone
+    void UpdateGainCycle(uint32_t inflight, Timepoint now) {
+        if (m_mode != BbrMode::probe_bw) {
+            return;
+        }
+        bool fullLength = now - m_cycleStamp > m_minRtt;
+        bool nextPhase = fullLength;
+        if (m_pacingGain > 1.0) {
+            nextPhase = fullLength && inflight >= Bdp(m_pacingGain);
+        } else if (m_pacingGain < 1.0) {
+            nextPhase = fullLength || inflight <= Bdp(1.0);
+        }
+        if (nextPhase) {
+            AdvanceCyclePhase(now);
+        }
+    }
+
+    /// refresh the min rtt, and drain the queue in ProbeRTT if it hasn't been refreshed for minRttWindow
+    void UpdateMinRtt(const AckEvent &ackEvent, Timepoint now) {
+        Duration sample = ackEvent.recvstic - ackEvent.sendtic;
+        bool expired = m_minRttStamp.IsInitialized() && now > m_minRttStamp + m_config.minRttWindow;
+        if (m_minRtt.IsZero() || sample <= m_minRtt || expired) {
+            m_minRtt = sample;
+            m_minRttStamp = now;
+        }
+
+        if (expired && m_mode != BbrMode::probe_rtt) {
+            m_mode = BbrMode::probe_rtt;
+            m_pacingGain = 1.0;
+            m_cwndGain = 1.0;
+            m_priorCwnd = m_cwnd;
+            m_probeRttDoneStamp = Timepoint::Zero();
+            SPDLOG_DEBUG("enter ProbeRTT, prior cwnd:{}", m_priorCwnd);
+        }
+
+        if (m_mode != BbrMode::probe_rtt) {
+            return;
+        }
+        if (!m_probeRttDoneStamp.IsInitialized()) {
+            if (ackEvent.inflight <= m_config.minCwnd) {
+                m_probeRttDoneStamp = now + m_config.probeRttTime;
+                m_probeRttRoundDone = false;
+                m_probeRttDelivered = ackEvent.delivered;
+            }
+            return;
+        }
+        // a round at the low window: a piece requested after it was reached has been answered
+        if (ackEvent.sentState.delivered >= m_probeRttDelivered) {
+            m_probeRttRoundDone = true;
+        }
+        if (m_probeRttRoundDone && now >= m_probeRttDoneStamp) {
+            m_minRttStamp = now;
+            m_cwnd = std::max(m_cwnd, m_priorCwnd);
+            if (m_fullBwReached) {
+                EnterProbeBw(now);
+            } else {
+                EnterStartup();
+            }
+            SPDLOG_DEBUG("exit ProbeRTT, mode:{}", static_cast<int>(m_mode));
+        }
+    }
+
+    void SetCwnd(const AckEvent &ackEvent) {
+        uint32_t target = Bdp(m_cwndGain);
+        if (m_fullBwReached) {
+            m_cwnd = std::min(m_cwnd + 1, target);
+        } else if (m_cwnd < target || ackEvent.delivered < static_cast<uint64_t>(m_config.initCwnd) * kDataPieceSize) {
+            m_cwnd += 1;
+        }
+        if (m_inflightHi > 0) {
+            m_cwnd = std::min(m_cwnd, m_inflightHi);
+        }
+        m_cwnd = BoundCwnd(m_cwnd);
+        if (m_mode == BbrMode::probe_rtt) {
+            m_cwnd = std::min(m_cwnd, m_config.minCwnd);
+        }
+    }
+
+    /// @return gain * max bandwidth * min rtt in pieces, initCwnd if there is no estimate yet
+    uint32_t Bdp(double gain) const {
+        if (m_maxBw == 0 || m_minRtt.IsZero()) {
+            return m_config.initCwnd;
+        }
+        double bdpBytes = gain * m_maxBw * m_minRtt.ToMicroseconds() / 1000000.0;
+        return static_cast<uint32_t>(std::ceil(bdpBytes / kDataPieceSize));
+    }
+
+    uint32_t BoundCwnd(uint32_t trySetCwnd) const {
+        return std::max(m_config.minCwnd, std::min(trySetCwnd, m_config.maxCwnd));
+    }
+
+    BbrCongestionCtlConfig m_config;
+    BbrMode m_mode{ BbrMode::startup };
+
+    uint64_t m_maxBw{ 0 };/** bytes per second, the sampler's max delivery rate as of the last ack*/
+    Duration m_minRtt{ Duration::Zero() };
+    Timepoint m_minRttStamp{ Timepoint::Zero() };
+
+    uint64_t m_roundCount{ 0 };
+    bool m_roundStart{ false };
+
+    uint64_t m_fullBw{ 0 };
+    uint32_t m_fullBwCnt{ 0 };
+    bool m_fullBwReached{ false };
+
+    double m_pacingGain{ kHighGain };
+    double m_cwndGain{ kHighGain };
+    uint32_t m_cycleIndex{ 0 };
+    Timepoint m_cycleStamp{ Timepoint::Zero() };
+
+    Timepoint m_probeRttDoneStamp{ Timepoint::Zero() };
+    bool m_probeRttRoundDone{ false };
+    uint64_t m_probeRttDelivered{ 0 };/** delivered when the low window of ProbeRTT was reached*/
+    uint32_t m_priorCwnd{ 0 };
+
+    uint32_t m_roundAcked{ 0 };
+    uint32_t m_roundLost{ 0 };
+    bool m_lossBoundInRound{ false };
+    uint32_t m_inflightHi{ 0 };/** bound on the pieces in flight set on loss, 0 if none*/
+    uint32_t m_inflightHiGrowth{ 1 };
+
+    uint32_t m_cwnd{ 10 };
+};
@@ -0,0 +1,223 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "demo/congestioncontrol.hpp"
+#include "utils/windowedfilter.hpp"
+
+struct CopaCongestionCtlConfig {
+    uint32_t minCwnd{ 2 };
+    uint32_t maxCwnd{ 256 };
+    uint32_t initCwnd{ 4 };
+    double delta{ 0.5 };/** the target rate is 1 / (delta * queueing delay), the standing queue is about 1 / delta*/
+    Duration minRttWindow{ Duration::FromSeconds(10) };
+    bool modeSwitch{ true };/** turn competitive against buffer filling cross traffic*/
+    uint32_t maxInvDelta{ 64 };/** bound of 1 / delta in competitive mode*/
+    bool shareQueueInGroup{ true };/** the sessions behind one bottleneck keep the standing queue of a single flow*/
+};
+
+enum class CopaMode : uint8_t {
+    slow_start = 0,
+    delay = 1,/** default mode, keeps a standing queue of about 1 / delta pieces*/
+    competitive = 2/** the queue never drains, 1 / delta grows additively and is halved on loss*/
+};
+
+/// Copa, a delay based congestion control, counting in data pieces.
+/// The queueing delay is the standing rtt, the min rtt over the last srtt / 2, minus the min rtt over minRttWindow.
+/// The window moves towards the target rate 1 / (delta * queueing delay) by velocity / (delta * cwnd) per ack, the
+/// velocity doubling each round once the window has moved the same way for 3 rounds. The queue drains regularly
+/// when only delay based flows share the bottleneck. If it hasn't been nearly empty for 5 rounds, some flow keeps
+/// it full and Copa turns competitive, growing 1 / delta by one each round and halving it on loss like AIMD.
+/// N Copa flows on a bottleneck keep N / delta pieces queued, which fills a shallow queue, so the sessions found
+/// behind the same bottleneck use N * delta, and keep the queue of a single flow between them.
+class CopaCongestionContrl : public CongestionCtlAlgo {
+public:
+
+    explicit CopaCongestionContrl(const CopaCongestionCtlConfig &ccConfig)
+            : m_config(ccConfig), m_minRttFilter(ccConfig.minRttWindow.ToMicroseconds(), 0),
+              m_standingRttFilter(0, 0), m_maxRttFilter(kQueueCheckRounds, 0), m_cwnd(ccConfig.initCwnd),
+              m_invDelta(1.0 / std::max(ccConfig.delta, 0.001)) {
+        m_cwnd = BoundCwnd(m_cwnd);
+        SPDLOG_DEBUG("minCwnd:{}, maxCwnd:{}, initCwnd:{}, delta:{}, modeSwitch:{}", m_config.minCwnd,
+                     m_config.maxCwnd, m_config.initCwnd, m_config.delta, m_config.modeSwitch);
+    }
+
+    ~CopaCongestionContrl() override {
+        SPDLOG_DEBUG("");
+    }
+
+    CongestionCtlType GetCCtype() override {
+        return CongestionCtlType::copa;
+    }
+
+    void OnDataSent(const InflightPacket &sentpkt) override {
+        SPDLOG_TRACE("");
+    }
+
+    void OnDataAckOrLoss(const AckEvent &ackEvent, const LossEvent &lossEvent, RttStats &rttstats) override {
+        SPDLOG_TRACE("ackevent:{}, lossevent:{}", ackEvent.DebugInfo(), lossEvent.DebugInfo());
+        if (lossEvent.valid) {
+            OnDataLoss();
+        }
+        if (!ackEvent.valid || rttstats.latest_rtt().IsZero()) {
+            return;
+        }
+
+        int64_t nowUs = (ackEvent.recvstic - Timepoint::Zero()).ToMicroseconds();
+        int64_t rttUs = rttstats.latest_rtt().ToMicroseconds();
+        m_minRttFilter.Update(rttUs, nowUs);
+        m_standingRttFilter.SetWindowLength(rttstats.SmoothedOrInitialRtt().ToMicroseconds() / 2);
+        m_standingRttFilter.Update(rttUs, nowUs);
+        UpdateRound(ackEvent, rttUs);
+
+        int64_t standingUs = m_standingRttFilter.GetBest();
+        int64_t queueDelayUs = standingUs - m_minRttFilter.GetBest();
+        // the current rate cwnd / standing rtt against the target rate 1 / (delta * queueing delay)
+        double invDelta = EffectiveInvDelta();
+        bool belowTarget = queueDelayUs <= 0 || m_cwnd * queueDelayUs <= standingUs * invDelta;
+
+        if (m_mode == CopaMode::slow_start) {
+            if (!belowTarget) {
+                SPDLOG_DEBUG("leave slow start, cwnd:{}, standing rtt:{}, queueing delay:{}", m_cwnd, standingUs,
+                             queueDelayUs);
+                m_mode = CopaMode::delay;
+            } else {
+                m_cwnd += 1;
+            }
+        } else {
+            double step = m_velocity * invDelta / std::max(m_cwnd, 1.0);
+            m_cwnd += belowTarget ? step : -step;
+        }
+        m_cwnd = BoundCwnd(m_cwnd);
+        SPDLOG_TRACE("mode:{}, cwnd:{}, velocity:{}, 1/delta:{}", static_cast<int>(m_mode), m_cwnd, m_velocity,
+                     m_invDelta);
+    }
+
+    void OnBottleneckGroup(uint32_t group, uint32_t groupSize) override {
+        m_groupSize = std::max(groupSize, 1U);
+    }
+
+    uint32_t GetCWND() override {
+        return static_cast<uint32_t>(m_cwnd);
+    }
+
+    void UpdateState() override {
+        // the state machine runs on acks
+    }
+
+    bool InSlowStart() override {
+        return m_mode == CopaMode::slow_start;
+    }
+
+    /// twice cwnd per standing rtt, so that the pieces of a window are spread over half an rtt
+    uint64_t GetPacingRate() override {
+        int64_t standingUs = m_standingRttFilter.GetBest();
+        if (standingUs <= 0) {
+            return 0;
+        }
+        return static_cast<uint64_t>(2 * m_cwnd * kDataPieceSize * 1000000.0 / standingUs);
+    }
+
+    CopaMode GetMode() const {
+        return m_mode;
+    }
+
+private:
+    static constexpr uint32_t kSameDirectionRounds = 3;/** rounds the window has to move the same way to speed up*/
+    static constexpr uint32_t kQueueCheckRounds = 5;/** the queue has to be nearly empty once in so many rounds*/
+    static constexpr double kNearlyEmpty = 0.1;/** of the max queueing delay*/
+
+    void OnDataLoss() {
+        m_lossInRound = true;
+        if (m_mode == CopaMode::slow_start) {
+            m_mode = CopaMode::delay;
+            m_cwnd = BoundCwnd(m_cwnd / 2);
+        }
+        if (m_mode == CopaMode::competitive) {
+            m_invDelta = std::max(m_invDelta / 2, DefaultInvDelta());
+        }
+    }
+
+    /// once per round: the velocity, and the mode from how empty the queue has got in the last rounds
+    void UpdateRound(const AckEvent &ackEvent, int64_t rttUs) {
+        m_roundMinRttUs = m_roundMinRttUs == 0 ? rttUs : std::min(m_roundMinRttUs, rttUs);
+        m_roundMaxRttUs = std::max(m_roundMaxRttUs, rttUs);
+        if (!ackEvent.rateSample.roundStart) {
+            return;
+        }
+        m_roundCount = ackEvent.rateSample.roundCount;
+
+        // velocity, bounded so that the window changes by at most a window per round
+        bool up = m_cwnd > m_roundStartCwnd;
+        if (m_cwnd != m_roundStartCwnd && up == m_lastUp) {
+            if (++m_sameDirectionCnt >= kSameDirectionRounds) {
+                m_velocity = std::min(m_velocity * 2, std::max(1.0, m_cwnd / EffectiveInvDelta()));
+            }
+        } else {
+            m_velocity = 1;
+            m_sameDirectionCnt = 0;
+        }
+        m_lastUp = up;
+        m_roundStartCwnd = m_cwnd;
+
+        // mode
+        m_maxRttFilter.Update(m_roundMaxRttUs, m_roundCount);
+        int64_t minRttUs = m_minRttFilter.GetBest();
+        int64_t maxQueueUs = m_maxRttFilter.GetBest() - minRttUs;
+        if (maxQueueUs <= 0 || m_roundMinRttUs - minRttUs < kNearlyEmpty * maxQueueUs) {
+            m_lastEmptyRound = m_roundCount;
+        }
+        if (m_config.modeSwitch && m_mode != CopaMode::slow_start) {
+            bool competitive = m_roundCount - m_lastEmptyRound >= kQueueCheckRounds;
+            if (competitive && m_mode == CopaMode::delay) {
+                SPDLOG_DEBUG("the queue hasn't drained for {} rounds, competitive mode", m_roundCount - m_lastEmptyRound);
+                m_mode = CopaMode::competitive;
+            } else if (!competitive && m_mode == CopaMode::competitive) {
+                SPDLOG_DEBUG("the queue has drained, delay mode");
+                m_mode = CopaMode::delay;
+                m_invDelta = DefaultInvDelta();
+            }
+        }
+        if (m_mode == CopaMode::competitive && !m_lossInRound) {
+            m_invDelta = std::min(m_invDelta + 1, static_cast<double>(m_config.maxInvDelta));
+        }
+        m_lossInRound = false;
+        m_roundMinRttUs = rttUs;
+        m_roundMaxRttUs = rttUs;
+    }
+
+    double EffectiveInvDelta() const {
+        return m_config.shareQueueInGroup ? m_invDelta / m_groupSize : m_invDelta;
+    }
+
+    double DefaultInvDelta() const {
+        return 1.0 / std::max(m_config.delta, 0.001);
+    }
+
+    double BoundCwnd(double trySetCwnd) const {
+        return std::max<double>(m_config.minCwnd, std::min<double>(trySetCwnd, m_config.maxCwnd));
+    }
+
+    CopaCongestionCtlConfig m_config;
+    CopaMode m_mode{ CopaMode::slow_start };
+
+    WindowedFilter<int64_t, MinFilter<int64_t>> m_minRttFilter;/** us, windowed by time*/
+    WindowedFilter<int64_t, MinFilter<int64_t>> m_standingRttFilter;/** us, over the last srtt / 2*/
+    WindowedFilter<int64_t, MaxFilter<int64_t>> m_maxRttFilter;/** us, windowed by round count*/
+
+    double m_cwnd{ 4 };/** fractional, a step is velocity / (delta * cwnd)*/
+    double m_invDelta{ 2 };/** 1 / delta*/
+    double m_velocity{ 1 };
+    uint32_t m_groupSize{ 1 };/** sessions behind the same bottleneck, this one included*/
+
+    uint64_t m_roundCount{ 0 };/** of the delivery rate sampler*/
+    double m_roundStartCwnd{ 0 };
+    bool m_lastUp{ true };
+    uint32_t m_sameDirectionCnt{ 0 };
+    int64_t m_roundMinRttUs{ 0 };
+    int64_t m_roundMaxRttUs{ 0 };
+    uint64_t m_lastEmptyRound{ 0 };/** the last round the queue has been nearly empty in*/
+    bool m_lossInRound{ false };
+};
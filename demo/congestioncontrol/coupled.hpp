@@ -0,0 +1,263 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include "demo/congestioncontrol.hpp"
+
+/// how the congestion avoidance increase is coupled across the sessions
+enum class CoupledAlgoType : uint8_t {
+    lia = 0,/** Linked Increases, RFC 6356*/
+    olia = 1,/** Opportunistic Linked Increases*/
+    balia = 2/** Balanced Linked Adaptation*/
+};
+
+struct CoupledCongestionCtlConfig {
+    CoupledAlgoType algo{ CoupledAlgoType::lia };
+    uint32_t minCwnd{ 1 };
+    uint32_t maxCwnd{ 64 };
+    uint32_t ssThresh{ 32 };/** slow start threshold, slow start isn't coupled*/
+};
+
+/// the window state of one session, as seen by the other sessions of the task
+struct CoupledSubflow {
+    double cwnd{ 1 };
+    double srttUs{ 0 };/** 0 until the session has an rtt sample*/
+    uint64_t ackedSinceLoss{ 0 };/** pieces acked since the last loss, l2 in OLIA*/
+    uint64_t ackedBetweenLosses{ 0 };/** pieces acked between the last two losses, l1 in OLIA*/
+    uint32_t bottleneckGroup{ 0 };/** only the sessions behind the same bottleneck are coupled*/
+};
+
+/// CoupledWindowCoordinator is shared by the coupled congestion controllers of the sessions of one transport
+/// controller. Each controller keeps its own subflow up to date, and asks the coordinator how much to increase per
+/// ack in congestion avoidance and where to go on loss, so that the sessions together take no more than a single
+/// flow on the best of their paths, while the window still moves to the less congested paths.
+/// Only the sessions in the same bottleneck group are coupled, all of them until the groups are known.
+/// All windows are in pieces and all rtts in microseconds. Sessions without an rtt sample are left out of the sums.
+class CoupledWindowCoordinator {
+public:
+    uint32_t Register() {
+        m_subflows[m_nextId] = CoupledSubflow();
+        return m_nextId++;
+    }
+
+    void Unregister(uint32_t subflowId) {
+        m_subflows.erase(subflowId);
+    }
+
+    CoupledSubflow &Subflow(uint32_t subflowId) {
+        return m_subflows[subflowId];
+    }
+
+    /// @return the congestion avoidance increase of the window of subflowId on one ack, it may be negative in OLIA
+    double IncreasePerAck(CoupledAlgoType algo, uint32_t subflowId) {
+        const CoupledSubflow &self = Subflow(subflowId);
+        if (self.srttUs <= 0 || self.cwnd <= 0) {
+            return 1.0 / std::max(self.cwnd, 1.0);
+        }
+        double totalCwnd = 0;
+        double sumRate = 0;/** sum of cwnd / rtt*/
+        double maxRate = 0;/** max of cwnd / rtt*/
+        double maxRateOverRtt = 0;/** max of cwnd / rtt^2*/
+        for (auto &&itor: m_subflows) {
+            const CoupledSubflow &subflow = itor.second;
+            if (!Coupled(self, subflow)) {
+                continue;
+            }
+            totalCwnd += subflow.cwnd;
+            sumRate += subflow.cwnd / subflow.srttUs;
+            maxRate = std::max(maxRate, subflow.cwnd / subflow.srttUs);
+            maxRateOverRtt = std::max(maxRateOverRtt, subflow.cwnd / (subflow.srttUs * subflow.srttUs));
+        }
+
+        switch (algo) {
+            case CoupledAlgoType::olia:
+                return self.cwnd / (self.srttUs * self.srttUs) / (sumRate * sumRate) + OliaAlpha(subflowId) / self.cwnd;
+            case CoupledAlgoType::balia: {
+                double rate = self.cwnd / self.srttUs;
+                double alpha = maxRate / rate;
+                return rate / (self.srttUs * sumRate * sumRate) * (1 + alpha) / 2 * (4 + alpha) / 5;
+            }
+            default: {
+                // never more than a single flow on this path would take
+                double alpha = totalCwnd * maxRateOverRtt / (sumRate * sumRate);
+                return std::min(alpha / totalCwnd, 1.0 / self.cwnd);
+            }
+        }
+    }
+
+    /// @return the window of subflowId after a loss
+    double WindowAfterLoss(CoupledAlgoType algo, uint32_t subflowId) {
+        const CoupledSubflow &self = Subflow(subflowId);
+        if (algo != CoupledAlgoType::balia || self.srttUs <= 0) {
+            return self.cwnd / 2;
+        }
+        double maxRate = 0;
+        for (auto &&itor: m_subflows) {
+            if (Coupled(self, itor.second)) {
+                maxRate = std::max(maxRate, itor.second.cwnd / itor.second.srttUs);
+            }
+        }
+        // the faster sessions back off less, down to a quarter of the window
+        double alpha = maxRate / (self.cwnd / self.srttUs);
+        return self.cwnd - self.cwnd / 2 * std::min(alpha, 1.5);
+    }
+
+private:
+    /// OLIA moves window from the sessions with the largest window to the best sessions which don't have it, the
+    /// best sessions being the ones with the largest l^2 / rtt, l being the pieces acked between losses
+    double OliaAlpha(uint32_t subflowId) {
+        const CoupledSubflow &self = Subflow(subflowId);
+        double maxCwnd = 0;
+        double maxQuality = 0;
+        uint32_t pathCnt = 0;
+        for (auto &&itor: m_subflows) {
+            if (!Coupled(self, itor.second)) {
+                continue;
+            }
+            ++pathCnt;
+            maxCwnd = std::max(maxCwnd, itor.second.cwnd);
+            maxQuality = std::max(maxQuality, Quality(itor.second));
+        }
+        uint32_t maxCwndCnt = 0;
+        uint32_t bestNotMaxCnt = 0;
+        for (auto &&itor: m_subflows) {
+            if (!Coupled(self, itor.second)) {
+                continue;
+            }
+            if (itor.second.cwnd >= maxCwnd) {
+                ++maxCwndCnt;
+            } else if (Quality(itor.second) >= maxQuality) {
+                ++bestNotMaxCnt;
+            }
+        }
+        if (bestNotMaxCnt == 0) {
+            return 0;
+        }
+        if (self.cwnd >= maxCwnd) {
+            return -1.0 / (pathCnt * maxCwndCnt);
+        }
+        if (Quality(self) >= maxQuality) {
+            return 1.0 / (pathCnt * bestNotMaxCnt);
+        }
+        return 0;
+    }
+
+    static bool Coupled(const CoupledSubflow &self, const CoupledSubflow &other) {
+        return other.srttUs > 0 && other.bottleneckGroup == self.bottleneckGroup;
+    }
+
+    static double Quality(const CoupledSubflow &subflow) {
+        double acked = static_cast<double>(std::max(subflow.ackedSinceLoss, subflow.ackedBetweenLosses));
+        return acked * acked / subflow.srttUs;
+    }
+
+    std::map<uint32_t, CoupledSubflow> m_subflows;
+    uint32_t m_nextId{ 0 };
+};
+
+/// Coupled multipath congestion control, counting in data pieces.
+/// Slow start and the loss reaction are per session as in Reno (BALIA scales the back off by the session rate),
+/// the congestion avoidance increase is coupled across the sessions by the CoupledWindowCoordinator.
+/// Like Reno, the window is reduced once per recovery episode.
+class CoupledCongestionContrl : public CongestionCtlAlgo {
+public:
+
+    CoupledCongestionContrl(const CoupledCongestionCtlConfig &ccConfig,
+                            std::shared_ptr<CoupledWindowCoordinator> coordinator)
+            : m_config(ccConfig), m_coordinator(std::move(coordinator)), m_ssThresh(ccConfig.ssThresh) {
+        m_subflowId = m_coordinator->Register();
+        m_cwnd = BoundCwnd(m_cwnd);
+        m_coordinator->Subflow(m_subflowId).cwnd = m_cwnd;
+        SPDLOG_DEBUG("algo:{}, minCwnd:{}, maxCwnd:{}, ssThresh:{}, subflow:{}", static_cast<int>(m_config.algo),
+                     m_config.minCwnd, m_config.maxCwnd, m_config.ssThresh, m_subflowId);
+    }
+
+    ~CoupledCongestionContrl() override {
+        SPDLOG_DEBUG("");
+        m_coordinator->Unregister(m_subflowId);
+    }
+
+    CongestionCtlType GetCCtype() override {
+        return CongestionCtlType::coupled;
+    }
+
+    void OnDataSent(const InflightPacket &sentpkt) override {
+        SPDLOG_TRACE("");
+        m_recovery.OnDataSent(sentpkt);
+    }
+
+    void OnDataAckOrLoss(const AckEvent &ackEvent, const LossEvent &lossEvent, RttStats &rttstats) override {
+        SPDLOG_TRACE("ackevent:{}, lossevent:{}", ackEvent.DebugInfo(), lossEvent.DebugInfo());
+        CoupledSubflow &subflow = m_coordinator->Subflow(m_subflowId);
+        if (!rttstats.smoothed_rtt().IsZero()) {
+            subflow.srttUs = static_cast<double>(rttstats.smoothed_rtt().ToMicroseconds());
+        }
+
+        if (lossEvent.valid && m_recovery.OnLoss(lossEvent)) {
+            m_lossUndo.OnReduction(GetCWND(), m_ssThresh, lossEvent);
+            subflow.ackedBetweenLosses = subflow.ackedSinceLoss;
+            subflow.ackedSinceLoss = 0;
+            m_cwnd = BoundCwnd(m_coordinator->WindowAfterLoss(m_config.algo, m_subflowId));
+            m_ssThresh = std::max(static_cast<uint32_t>(m_cwnd), m_config.minCwnd);
+            subflow.cwnd = m_cwnd;
+        }
+
+        if (ackEvent.valid) {
+            m_recovery.OnAck(ackEvent);
+            ++subflow.ackedSinceLoss;
+            if (InSlowStart()) {
+                m_cwnd += 1;
+            } else {
+                m_cwnd += m_coordinator->IncreasePerAck(m_config.algo, m_subflowId);
+            }
+            m_cwnd = BoundCwnd(m_cwnd);
+            subflow.cwnd = m_cwnd;
+        }
+        SPDLOG_TRACE("cwnd:{}, ssThresh:{}", m_cwnd, m_ssThresh);
+    }
+
+    void OnSpuriousLoss(const InflightPacket &lostpkt) override {
+        if (m_lossUndo.OnSpuriousLoss(lostpkt)) {
+            m_cwnd = BoundCwnd(std::max<double>(m_cwnd, m_lossUndo.priorCwnd));
+            m_ssThresh = std::max(m_ssThresh, m_lossUndo.priorSsThresh);
+            m_coordinator->Subflow(m_subflowId).cwnd = m_cwnd;
+            m_recovery.Exit();
+        }
+    }
+
+    bool InRecovery() override {
+        return m_recovery.inRecovery;
+    }
+
+    void OnBottleneckGroup(uint32_t group, uint32_t groupSize) override {
+        m_coordinator->Subflow(m_subflowId).bottleneckGroup = group;
+    }
+
+    uint32_t GetCWND() override {
+        return static_cast<uint32_t>(m_cwnd);
+    }
+
+    void UpdateState() override {
+    }
+
+    bool InSlowStart() override {
+        return m_cwnd < m_ssThresh;
+    }
+
+private:
+    double BoundCwnd(double trySetCwnd) const {
+        return std::max<double>(m_config.minCwnd, std::min<double>(trySetCwnd, m_config.maxCwnd));
+    }
+
+    CoupledCongestionCtlConfig m_config;
+    std::shared_ptr<CoupledWindowCoordinator> m_coordinator;
+    uint32_t m_subflowId{ 0 };
+    double m_cwnd{ 1 };/** fractional, the coupled increase per ack is less than a piece*/
+    uint32_t m_ssThresh{ 32 };
+    LossUndoState m_lossUndo;
+    RecoveryState m_recovery;
+};
@@ -8,12 +8,85 @@
 #include "thirdparty/quiche/cubic_bytes.h"
 
 struct CubicCongestionCtlConfig {
+    bool hystartEnabled{ true };/** leave slow start on rtt increase with HyStart++, before the queue overflows*/
+    uint32_t hystartMinRttSamples{ 8 };/** rtt samples a round needs before its min rtt is compared*/
+    Duration hystartMinRttThresh{ Duration::FromMilliseconds(4) };
+    Duration hystartMaxRttThresh{ Duration::FromMilliseconds(16) };
+    uint32_t cssGrowthDivisor{ 4 };/** slow start growth is divided by this in Conservative Slow Start*/
+    uint32_t cssRounds{ 5 };/** rounds in Conservative Slow Start before slow start ends*/
+};
+
+/// HyStart++ (RFC 9406) slow start exit, fed with the rtt of every ack.
+/// The rounds are the ones of the delivery rate sampler. Once a round has got enough rtt samples
+/// and its min rtt is above the one of the previous round by an eighth of it, clamped to [4 ms, 16 ms], slow start
+/// goes on in Conservative Slow Start, growing cssGrowthDivisor times slower. If the min rtt falls back below the
+/// baseline the increase was a jitter and slow start resumes, otherwise slow start ends after cssRounds rounds.
+class HyStartPlusPlus {
+public:
+    explicit HyStartPlusPlus(const CubicCongestionCtlConfig &ccConfig) : m_config(ccConfig) {
+    }
+
+    /// @return the divisor of the slow start growth on this ack, 0 when slow start should end
+    uint32_t OnAck(const AckEvent &ackEvent, Duration rtt) {
+        if (ackEvent.rateSample.roundStart) {
+            m_lastRoundMinRtt = m_curRoundMinRtt;
+            m_curRoundMinRtt = Duration::Infinite();
+            m_rttSampleCnt = 0;
+            if (m_inCss && ++m_cssRoundCnt >= m_config.cssRounds) {
+                SPDLOG_DEBUG("leave slow start after {} css rounds, baseline min rtt: {}", m_cssRoundCnt,
+                             m_cssBaselineMinRtt.ToDebuggingValue());
+                return 0;
+            }
+        }
+
+        m_curRoundMinRtt = std::min(m_curRoundMinRtt, rtt);
+        ++m_rttSampleCnt;
+        if (m_rttSampleCnt >= m_config.hystartMinRttSamples && !m_lastRoundMinRtt.IsInfinite()) {
+            if (!m_inCss) {
+                Duration rttThresh = std::max(m_config.hystartMinRttThresh,
+                                              std::min(m_lastRoundMinRtt * 0.125, m_config.hystartMaxRttThresh));
+                if (m_curRoundMinRtt >= m_lastRoundMinRtt + rttThresh) {
+                    SPDLOG_DEBUG("enter css, min rtt last round: {}, this round: {}",
+                                 m_lastRoundMinRtt.ToDebuggingValue(), m_curRoundMinRtt.ToDebuggingValue());
+                    m_inCss = true;
+                    m_cssRoundCnt = 0;
+                    m_cssBaselineMinRtt = m_curRoundMinRtt;
+                }
+            } else if (m_curRoundMinRtt < m_cssBaselineMinRtt) {
+                SPDLOG_DEBUG("back to slow start, min rtt: {} below baseline: {}",
+                             m_curRoundMinRtt.ToDebuggingValue(), m_cssBaselineMinRtt.ToDebuggingValue());
+                m_inCss = false;
+            }
+        }
+        return m_inCss ? std::max(m_config.cssGrowthDivisor, 1U) : 1;
+    }
+
+    /// slow start is entered again, the rounds are counted from the next ack
+    void Restart() {
+        m_inCss = false;
+        m_cssRoundCnt = 0;
+        m_rttSampleCnt = 0;
+        m_lastRoundMinRtt = Duration::Infinite();
+        m_curRoundMinRtt = Duration::Infinite();
+    }
+
+private:
+    CubicCongestionCtlConfig m_config;
+    uint32_t m_rttSampleCnt{ 0 };/** rtt samples in the current round*/
+    Duration m_lastRoundMinRtt{ Duration::Infinite() };
+    Duration m_curRoundMinRtt{ Duration::Infinite() };
+    bool m_inCss{ false };
+    uint32_t m_cssRoundCnt{ 0 };
+    Duration m_cssBaselineMinRtt{ Duration::Infinite() };
 };
 
 class CubicCongestionContrl : public CongestionCtlAlgo {
 public:
 
-    explicit CubicCongestionContrl(const CubicCongestionCtlConfig &ccConfig) : cubic_(DefaultClock::GetClock()) {
+    explicit CubicCongestionContrl(const CubicCongestionCtlConfig &ccConfig)
+            : m_config(ccConfig), cubic_(Clock::GetClock()), m_hystart(ccConfig) {
+        SPDLOG_DEBUG("hystartEnabled:{}, cssGrowthDivisor:{}, cssRounds:{}", m_config.hystartEnabled,
+                     m_config.cssGrowthDivisor, m_config.cssRounds);
         cubic_.ResetCubicState();
         cubic_.SetNumConnections(basefw::quic::kDefaultNumConnections);
     }
@@ -28,14 +101,15 @@ public:
 
     void OnDataSent(const InflightPacket &sentpkt) override {
         SPDLOG_TRACE("");
-        // do nothing
+        m_recovery.OnDataSent(sentpkt);
     }
 
     void OnDataAckOrLoss(const AckEvent &ackEvent, const LossEvent &lossEvent, RttStats &rttstats) override {
         SPDLOG_TRACE("ackevent:{}, lossevent:{}", ackEvent.DebugInfo(), lossEvent.DebugInfo());
 
-        if (lossEvent.valid) {
+        if (lossEvent.valid && m_recovery.OnLoss(lossEvent)) {
             SPDLOG_TRACE("lossEvent");
+            m_lossUndo.OnReduction(m_kcwnd, m_kssThresh, lossEvent);
             if(InSlowStart()){
                 if(m_state == 0){
                     if(m_kcwnd < 2 * m_initkcwnd){
@@ -52,6 +126,7 @@ public:
                 m_kcwnd = cubic_.CongestionWindowAfterPacketLoss(m_kcwnd);
             }
             m_kssThresh =m_kcwnd;
+            m_hystart.Restart();
 
             if(m_kcwnd < m_kminCwnd){
                 m_kcwnd = m_kminCwnd;
@@ -60,8 +135,16 @@ public:
 
         if (ackEvent.valid) {
             SPDLOG_TRACE("ackEvent");
+            m_recovery.OnAck(ackEvent);
             if(InSlowStart()) {
-                m_kcwnd += basefw::quic::kDefaultTCPMSS;
+                uint32_t growthDivisor = m_config.hystartEnabled ? m_hystart.OnAck(ackEvent, rttstats.latest_rtt()) : 1;
+                if (growthDivisor == 0) {
+                    // the queue is building up, go on with cubic from here
+                    m_kssThresh = m_kcwnd;
+                    m_state = 0;
+                } else {
+                    m_kcwnd += basefw::quic::kDefaultTCPMSS / growthDivisor;
+                }
             }else{
                 m_kcwnd = cubic_.CongestionWindowAfterAck(basefw::quic::kDefaultTCPMSS, m_kcwnd,
                                                           rttstats.MinOrInitialRtt(),ackEvent.recvstic);
@@ -72,15 +155,29 @@ public:
         }
     }
 
+    void OnSpuriousLoss(const InflightPacket &lostpkt) override {
+        if (m_lossUndo.OnSpuriousLoss(lostpkt)) {
+            m_kcwnd = std::max(m_kcwnd, m_lossUndo.priorCwnd);
+            m_kssThresh = std::max(m_kssThresh, m_lossUndo.priorSsThresh);
+            m_recovery.Exit();
+        }
+    }
+
+    bool InRecovery() override {
+        return m_recovery.inRecovery;
+    }
+
     uint32_t GetCWND() override {
         return BoundCwnd(m_kcwnd)/basefw::quic::kDefaultTCPMSS;
     }
 
+    /// the rtt plateau check of the loss alarm, HyStart++ already decides when to re-enter slow start
     void UpdateState() override{
-        if(!InSlowStart()) {
+        if(!InSlowStart() && !m_config.hystartEnabled) {
             m_prekCwnd = m_kcwnd;
             m_kssThresh = 4 * m_prekCwnd;
             m_state = 1;
+            m_hystart.Restart();
         }
 
 //        if(!InSlowStart()){
@@ -105,7 +202,9 @@ private:
         return std::max(m_kminCwnd, std::min(trySetCwnd, m_kmaxCwnd));
     }
 
+    CubicCongestionCtlConfig m_config;
     basefw::quic::CubicBytes cubic_;
+    HyStartPlusPlus m_hystart;
 
     uint32_t m_kcwnd{3000};
     uint32_t m_initkcwnd{3000};
@@ -123,4 +222,6 @@ private:
 
     uint32_t m_prekCwnd{1000};
     uint8_t m_state = 0;
+    LossUndoState m_lossUndo;/** in bytes*/
+    RecoveryState m_recovery;
 };
\ No newline at end of file
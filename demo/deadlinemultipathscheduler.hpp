@@ -0,0 +1,209 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include "rrmultipathscheduler.hpp"
+
+/// config for DeadlineMultiPathScheduler
+struct DeadlineSchedulerConfig {
+    uint32_t defaultByteRate{ 1024 * 1024 / 8 };/** bytes per second, used when the player byte rate is unknown*/
+    Duration urgentWindow{ Duration::FromSeconds(2) };/** pieces to be played within this window are urgent*/
+    Duration initialRtt{ Duration::FromMilliseconds(200) };/** rtt assumed for a session without rtt sample*/
+};
+
+/// Deadline aware multipath scheduler.
+/// Each piece gets a playback deadline from the play position and the byte rate. Urgent pieces are only handed to
+/// the sessions which are expected to deliver them in time, the rest are filled up in min RTT first order.
+class DeadlineMultiPathScheduler : public RRMultiPathScheduler {
+public:
+    MultiPathSchedulerType SchedulerType() override {
+        return MultiPathSchedulerType::MULTI_PATH_SCHEDULE_DEADLINE;
+    }
+
+    explicit DeadlineMultiPathScheduler(const fw::ID &taskid,
+                                        std::map<fw::ID, fw::shared_ptr<SessionStreamController>> &dlsessionmap,
+                                        PieceWindow &downloadQueue, PieceWindow &lostPiecesQueue,
+                                        PieceTable &pieceTable,
+                                        const DeadlineSchedulerConfig &config,
+                                        const EndgameConfig &endgameConfig = EndgameConfig(),
+                                        const OppRetransConfig &oppRetransConfig = OppRetransConfig(),
+                                        const SessionHealthConfig &healthConfig = SessionHealthConfig())
+            : RRMultiPathScheduler(taskid, dlsessionmap, downloadQueue, lostPiecesQueue, pieceTable,
+                                   endgameConfig.maxDuplicateBytes),
+              m_config(config) {
+        SPDLOG_DEBUG("taskid :{}, urgentWindow: {}", taskid.ToLogStr(), m_config.urgentWindow.ToDebuggingValue());
+        EnableEndgame(endgameConfig);
+        EnableOppRetrans(oppRetransConfig);
+        EnableSessionHealth(healthConfig);
+    }
+
+    ~DeadlineMultiPathScheduler() override {
+        SPDLOG_TRACE("");
+    }
+
+    uint32_t DoSinglePathSchedule(const fw::ID &sessionid) override {
+        SPDLOG_DEBUG("session:{}", sessionid.ToLogStr());
+
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor == m_dlsessionmap.end() || !session_itor->second) {
+            SPDLOG_WARN("Unknown session: {}", sessionid.ToLogStr());
+            return -1;
+        }
+
+        MergeLostPieces();
+
+        if (session_itor->second->CanRequestPktCnt() == 0) {
+            SPDLOG_TRACE("Free Wnd equals to 0");
+            return -1;
+        }
+        // the pieces already queued on the session are sent first
+        auto uni32DataReqCnt = SchedulableCnt(sessionid, session_itor->second);
+
+        if (m_downloadQueue.size() < uni32DataReqCnt) {
+            auto handler = m_phandler.lock();
+            if (handler) {
+                handler->OnRequestDownloadPieces(uni32DataReqCnt - m_downloadQueue.size());
+            } else {
+                SPDLOG_ERROR("handler = null");
+            }
+        }
+
+        // only this session has free window, the others are still used to judge whether a deadline can be met
+        std::map<basefw::ID, uint32_t> toSendinEachSession{ { sessionid, uni32DataReqCnt } };
+        AssignSessionTasks(toSendinEachSession);
+
+        DoSendSessionSubTask(sessionid);
+        return 0;
+    }
+
+protected:
+    void AssignSessionTasks(std::map<basefw::ID, uint32_t> &toSendinEachSession) override {
+        uint64_t playpos = 0;
+        uint32_t byterate = 0;
+        if (!GetPlayState(playpos, byterate)) {
+            SPDLOG_DEBUG("play state unknown, fall back to min RTT first");
+            RRMultiPathScheduler::AssignSessionTasks(toSendinEachSession);
+            return;
+        }
+
+        // 1. estimate when the next piece handed to each session will be delivered
+        std::vector<SessionSlot> slots;
+        uint32_t totalFreeCnt = 0;
+        for (auto &&itor: m_dlsessionmap) {
+            auto &sessStream = itor.second;
+            if (!sessStream || IsQuarantined(itor.first)) {
+                continue;
+            }
+            SessionSlot slot;
+            slot.sessId = itor.first;
+            auto &&id_sendcnt = toSendinEachSession.find(itor.first);
+            slot.freeCnt = id_sendcnt != toSendinEachSession.end() ? id_sendcnt->second : 0;
+
+            Duration rtt = sessStream->GetRtt();
+            if (rtt.IsZero()) {
+                rtt = m_config.initialRtt;
+            }
+            uint32_t cwnd = std::max(sessStream->GetCWND(), 1U);
+            uint32_t queued = sessStream->GetInFlightPktNum() + m_session_needdownloadpieceQ[itor.first].size();
+            slot.rttUs = rtt.ToMicroseconds();
+            slot.perPieceUs = slot.rttUs / cwnd;
+            slot.estDelayUs = slot.rttUs + queued * slot.perPieceUs;
+
+            totalFreeCnt += slot.freeCnt;
+            slots.emplace_back(slot);
+        }
+        if (slots.empty() || totalFreeCnt == 0) {
+            return;
+        }
+        std::sort(slots.begin(), slots.end(), [](const SessionSlot &a, const SessionSlot &b) {
+            return a.rttUs < b.rttUs;
+        });
+
+        // 2. go through the pieces in ascending order, urgent pieces go to the sessions able to meet the deadline
+        const int64_t urgentUs = m_config.urgentWindow.ToMicroseconds();
+        for (auto itr = m_downloadQueue.begin(); itr != m_downloadQueue.end() && totalFreeCnt > 0;) {
+            DataNumber pno = *itr++;
+            int64_t pieceOffset = static_cast<int64_t>(pno) * kDataPieceSize;
+            int64_t slackUs = (pieceOffset - static_cast<int64_t>(playpos)) * 1000000 / byterate;
+
+            SessionSlot *chosen = nullptr;
+            if (slackUs < urgentUs) {
+                SessionSlot *feasible = nullptr;
+                SessionSlot *fastestFree = nullptr;
+                bool anyCanMeet = false;
+                for (auto &&slot: slots) {
+                    bool canMeet = slot.estDelayUs <= slackUs;
+                    anyCanMeet = anyCanMeet || canMeet;
+                    if (slot.freeCnt == 0) {
+                        continue;
+                    }
+                    if (canMeet && (!feasible || slot.estDelayUs < feasible->estDelayUs)) {
+                        feasible = &slot;
+                    }
+                    if (!fastestFree || slot.estDelayUs < fastestFree->estDelayUs) {
+                        fastestFree = &slot;
+                    }
+                }
+                if (feasible) {
+                    chosen = feasible;
+                } else if (!anyCanMeet) {
+                    // it will be late anyway, take the earliest delivery
+                    chosen = fastestFree;
+                } else {
+                    // a busy session can still make it, hold the piece back for it
+                    SPDLOG_TRACE("hold urgent piece {}, slack {} us", pno, slackUs);
+                    continue;
+                }
+            } else {
+                for (auto &&slot: slots) {
+                    if (slot.freeCnt > 0) {
+                        chosen = &slot;
+                        break;
+                    }
+                }
+            }
+
+            chosen->pieces.push_back(pno);
+            chosen->freeCnt--;
+            chosen->estDelayUs += chosen->perPieceUs;
+            --totalFreeCnt;
+            m_downloadQueue.Erase(pno);
+        }
+
+        for (auto &&slot: slots) {
+            if (!slot.pieces.empty()) {
+                SPDLOG_TRACE("session {} gets pieces {}", slot.sessId.ToLogStr(), slot.pieces);
+                m_session_needdownloadpieceQ[slot.sessId].Insert(slot.pieces.begin(), slot.pieces.end());
+            }
+        }
+    }
+
+private:
+    struct SessionSlot {
+        fw::ID sessId;
+        uint32_t freeCnt{ 0 };
+        int64_t rttUs{ 0 };
+        int64_t perPieceUs{ 0 };/** time to push one more piece through this session*/
+        int64_t estDelayUs{ 0 };/** expected delay of the next piece assigned to this session*/
+        std::vector<DataNumber> pieces;
+    };
+
+    /// the play position is taken from the player, or the cache position if the player doesn't tell
+    bool GetPlayState(uint64_t &playpos, uint32_t &byterate) {
+        auto handler = m_phandler.lock();
+        if (!handler) {
+            SPDLOG_ERROR("handler = null");
+            return false;
+        }
+        if (!handler->OnGetByteRate(byterate) || byterate == 0) {
+            byterate = m_config.defaultByteRate;
+        }
+        if (handler->OnGetCurrPlayPos(playpos)) {
+            return true;
+        }
+        return handler->OnGetCurrCachePos(playpos);
+    }
+
+    DeadlineSchedulerConfig m_config;
+};
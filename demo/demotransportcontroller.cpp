@@ -13,6 +13,13 @@ std::string DemoTransportCtlConfig::DebugInfo()
     ss
             << "{"
             << "minWnd:" << minWnd << " maxWnd:" << maxWnd << " slowStartThreshold:" << slowStartThreshold
+            << " congestionCtlType:" << static_cast<int>(congestionCtlType)
+            << " playByteRate:" << playByteRate << " multipathSchedulerType:" << multipathSchedulerType
+            << " lossDetectType:" << static_cast<int>(lossDetectType)
+            << " pacingEnabled:" << pacingEnabled << " pacingBurstQuantum:" << pacingBurstQuantum
+            << " pacingGain:" << pacingGain << " spuriousLossUndo:" << spuriousLossUndo
+            << " hystartEnabled:" << hystartEnabled << " lossDifferentiation:" << lossDifferentiationConfig.enabled
+            << " prrEnabled:" << prrEnabled
             << " }";
     return ss.str();
 }
@@ -23,9 +30,26 @@ DemoTransportCtl::DemoTransportCtl(std::shared_ptr<TransPortControllerConfig> ct
 {
     //multipathscheduler = std::make_shared(RRMultiPathScheduler());
     m_transCtlConfig = std::dynamic_pointer_cast<DemoTransportCtlConfig>(ctlConfig);
+    if (!m_transCtlConfig)
+    {
+        SPDLOG_ERROR("config isn't a DemoTransportCtlConfig, using the defaults");
+        m_transCtlConfig = std::make_shared<DemoTransportCtlConfig>();
+    }
     renoccConfig.minCwnd = m_transCtlConfig->minWnd;
     renoccConfig.maxCwnd = m_transCtlConfig->maxWnd;
     renoccConfig.ssThresh = m_transCtlConfig->slowStartThreshold;
+    m_sessStreamCtlConfig.lossDetectType = m_transCtlConfig->lossDetectType;
+    // bbr sets the sending rate by its pacing gain, without pacing it would send its whole window at once
+    m_sessStreamCtlConfig.pacingEnabled = m_transCtlConfig->pacingEnabled ||
+            m_transCtlConfig->congestionCtlType == CongestionCtlType::bbr;
+    m_sessStreamCtlConfig.pacingBurstQuantum = m_transCtlConfig->pacingBurstQuantum;
+    m_sessStreamCtlConfig.pacingGain = m_transCtlConfig->pacingGain;
+    m_sessStreamCtlConfig.spuriousLossUndo = m_transCtlConfig->spuriousLossUndo;
+    m_sessStreamCtlConfig.prrEnabled = m_transCtlConfig->prrEnabled;
+    cubicConfig.hystartEnabled = m_transCtlConfig->hystartEnabled;
+    m_sessStreamCtlConfig.sbdConfig = m_transCtlConfig->sharedBottleneckConfig;
+    m_sessStreamCtlConfig.lossDiffConfig = m_transCtlConfig->lossDifferentiationConfig;
+    m_sbDetector = SharedBottleneckDetector(m_transCtlConfig->sharedBottleneckConfig);
     SPDLOG_DEBUG("config:{}", m_transCtlConfig->DebugInfo());
 }
 
@@ -58,9 +82,37 @@ bool DemoTransportCtl::StartTransportController(TransportDownloadTaskInfo tansDl
     SPDLOG_DEBUG("taskid: {}", tansDlTkInfo.m_rid.ToLogStr());
 
     m_transctlHandler = transCtlHandler;
+    m_tansDlTkInfo = tansDlTkInfo;
 
-    m_multipathscheduler.reset(
-            new RRMultiPathScheduler(m_tansDlTkInfo.m_rid, m_sessStreamCtlMap, m_downloadPieces, m_lostPiecesl));
+    switch (m_transCtlConfig->multipathSchedulerType)
+    {
+        case MultiPathSchedulerType::MULTI_PATH_SCHEDULE_DEADLINE:
+            m_multipathscheduler.reset(
+                    new DeadlineMultiPathScheduler(m_tansDlTkInfo.m_rid, m_sessStreamCtlMap, m_downloadPieces,
+                            m_lostPiecesl, m_pieceTable, m_transCtlConfig->deadlineSchedulerConfig,
+                            m_transCtlConfig->endgameConfig, m_transCtlConfig->oppRetransConfig,
+                            m_transCtlConfig->sessionHealthConfig));
+            break;
+        case MultiPathSchedulerType::MULTI_PATH_SCHEDULE_STRIPE:
+            m_multipathscheduler.reset(
+                    new StripeMultiPathScheduler(m_tansDlTkInfo.m_rid, m_sessStreamCtlMap, m_downloadPieces,
+                            m_lostPiecesl, m_pieceTable, m_transCtlConfig->stripeSchedulerConfig,
+                            m_transCtlConfig->endgameConfig, m_transCtlConfig->sessionHealthConfig));
+            break;
+        case MultiPathSchedulerType::MULTI_PATH_SCHEDULE_ECF:
+            m_multipathscheduler.reset(
+                    new EcfMultiPathScheduler(m_tansDlTkInfo.m_rid, m_sessStreamCtlMap, m_downloadPieces,
+                            m_lostPiecesl, m_pieceTable, m_transCtlConfig->ecfSchedulerConfig,
+                            m_transCtlConfig->endgameConfig, m_transCtlConfig->oppRetransConfig,
+                            m_transCtlConfig->sessionHealthConfig));
+            break;
+        default:
+            m_multipathscheduler.reset(
+                    new RRMultiPathScheduler(m_tansDlTkInfo.m_rid, m_sessStreamCtlMap, m_downloadPieces,
+                            m_lostPiecesl, m_pieceTable, m_transCtlConfig->endgameConfig,
+                            m_transCtlConfig->oppRetransConfig, m_transCtlConfig->sessionHealthConfig));
+            break;
+    }
     m_multipathscheduler->StartMultiPathScheduler(shared_from_this());
     return true;
 }
@@ -113,8 +165,8 @@ void DemoTransportCtl::OnSessionCreate(const fw::ID& sessionid)
     {
         m_sessStreamCtlMap[sessionid] = std::make_shared<SessionStreamController>();
         m_sessStreamCtlMap[sessionid]->StartSessionStreamCtl(sessionid,
-                                                             new RenoCongestionContrl(renoccConfig),
-                                                             shared_from_this());
+                                                             NewCongestionCtl(),
+                                                             shared_from_this(), m_sessStreamCtlConfig);
     }
     else
     {
@@ -157,13 +209,16 @@ void DemoTransportCtl::OnSessionDestory(const fw::ID& sessionid)
     if (sessionItor == m_sessStreamCtlMap.end())
     {
         // warn: try to destroy a session we don't know
+        SPDLOG_WARN(" try to destroy a session we don't know");
+        return;
     }
-    else
+    sessionItor->second->StopSessionStreamCtl();
+    m_sessStreamCtlMap.erase(sessionItor);
+    // hand the reclaimed pieces to the other sessions right away
+    if (isRunning && m_multipathscheduler)
     {
-        m_sessStreamCtlMap[sessionid]->StopSessionStreamCtl();
-        m_sessStreamCtlMap[sessionid].reset();
+        m_multipathscheduler->DoMultiPathSchedule();
     }
-
 }
 
 /**
@@ -173,14 +228,26 @@ void DemoTransportCtl::OnSessionDestory(const fw::ID& sessionid)
 void DemoTransportCtl::OnPieceTaskAdding(std::vector<int32_t>& datapiecesVec)
 {
     SPDLOG_DEBUG("datapiecesVec {}", datapiecesVec);
-    for (auto&& dataPiece: datapiecesVec)
+    // pieces are usually added in ascending runs, insert each run at once. A piece added again is skipped, it's
+    // already queued, in flight or received.
+    int64_t runStart = 0;
+    int64_t runEnd = -1;
+    for (auto&& pno: datapiecesVec)
     {
-        auto rt = m_downloadPieces.emplace(dataPiece);
-        if (!rt.second)
+        if (!m_pieceTable.OnAdded(pno))
+        {
+            SPDLOG_DEBUG("piece {} is already known", pno);
+            continue;
+        }
+        if (pno != runEnd)
         {
-            // warning: already has
+            m_downloadPieces.InsertRange(static_cast<DataNumber>(runStart), static_cast<DataNumber>(runEnd));
+            runStart = pno;
         }
+        runEnd = static_cast<int64_t>(pno) + 1;
+        m_addedPieceEnd = std::max<uint64_t>(m_addedPieceEnd, runEnd);
     }
+    m_downloadPieces.InsertRange(static_cast<DataNumber>(runStart), static_cast<DataNumber>(runEnd));
     // Do multipath schedule after new tasks added
     m_multipathscheduler->DoMultiPathSchedule();
 }
@@ -221,6 +288,9 @@ void DemoTransportCtl::OnDataPiecesReceived(const fw::ID& sessionid, uint32_t se
 {
     SPDLOG_TRACE("session = {}, seq ={},datapiece = {},tic_us = {}",sessionid.ToLogStr(),seq,datapiece,tic_us);
     Timepoint recvtic = Clock::GetClock()->CreateTimeFromMicroseconds(tic_us);
+    // advance the contiguous received part
+    m_pieceTable.OnReceived(datapiece);
+    m_recvBitmap.Insert(datapiece);
     // call session control firstly to change cwnd first
     auto&& sessionItor = m_sessStreamCtlMap.find(sessionid);
     if (sessionItor != m_sessStreamCtlMap.end())
@@ -234,6 +304,7 @@ void DemoTransportCtl::OnDataPiecesReceived(const fw::ID& sessionid, uint32_t se
     }
     // inform multipath scheduler
     m_multipathscheduler->OnReceiveSubpieceData(sessionid, seq, datapiece, recvtic);
+    ServicePacedSessions();
 }
 
 /**
@@ -252,6 +323,10 @@ void DemoTransportCtl::OnDataSent(const fw::ID& sessionid, const std::vector<int
             sessionid.ToLogStr(),
             datapiecesvec,
             seqvec, senttime_us);
+    if (!m_firstSentTic.IsInitialized())
+    {
+        m_firstSentTic = Clock::GetClock()->CreateTimeFromMicroseconds(senttime_us);
+    }
     auto&& sessStreamItor = m_sessStreamCtlMap.find(sessionid);
     if (sessStreamItor != m_sessStreamCtlMap.end())
     {
@@ -275,8 +350,13 @@ void DemoTransportCtl::OnLossDetectionAlarm()
     {
         sessStreamItor.second->OnLossDetectionAlarm();
     }
+    // then regroup the sessions by the bottleneck they are behind
+    UpdateBottleneckGroups();
     // Step 2: Forward message to Multipath Scheduler
+    m_multipathscheduler->OnLossDetectionAlarm();
     m_multipathscheduler->DoMultiPathSchedule();
+    // Step 3: paced sessions may have earned their tokens since the last packet arrived
+    ServicePacedSessions();
 }
 
 // session stream handler
@@ -292,6 +372,15 @@ void DemoTransportCtl::OnPiecePktTimeout(const basefw::ID& peerid, const std::ve
 
 }
 
+void DemoTransportCtl::OnPieceSpuriousLoss(const basefw::ID& peerid, int32_t spn)
+{
+    if (!isRunning)
+    {
+        return;
+    }
+    m_multipathscheduler->OnSpuriousLoss(peerid, spn);
+}
+
 bool DemoTransportCtl::DoSendDataRequest(const basefw::ID& peerid, const std::vector<int32_t>& spns)
 {
     SPDLOG_TRACE("peerid = {}, spns= {}", peerid.ToLogStr(), spns);
@@ -323,19 +412,46 @@ bool DemoTransportCtl::DoSendDataRequest(const basefw::ID& peerid, const std::ve
 bool DemoTransportCtl::OnGetCurrPlayPos(uint64_t& currplaypos)
 {
     // curr play pos in Byte
-    return false;
+    // the player doesn't report its position to transport layer, so assume it plays at byte rate
+    // since the first data request, which is also where the score module starts the clock
+    uint32_t playbyterate = 0;
+    if (!m_firstSentTic.IsInitialized() || !OnGetByteRate(playbyterate))
+    {
+        return false;
+    }
+    auto elapsed = Clock::GetClock()->Now() - m_firstSentTic;
+    currplaypos = std::max(elapsed.ToMicroseconds(), int64_t(0)) * playbyterate / 1000000;
+    currplaypos = std::min(currplaypos, m_tansDlTkInfo.m_filelength);
+    return true;
 }
 
 bool DemoTransportCtl::OnGetCurrCachePos(uint64_t& currcachepos)
 {
-    return false;
+    // contiguous downloaded data in Byte
+    currcachepos = static_cast<uint64_t>(m_recvBitmap.ContiguousEnd()) * kDataPieceSize;
+    return true;
+}
 
+bool DemoTransportCtl::OnGetHeadOfLineGap(DataNumber& gapstart, DataNumber& gapend)
+{
+    // the missing pieces right after the contiguous part, in piece numbers
+    gapstart = m_recvBitmap.ContiguousEnd();
+    gapend = m_recvBitmap.NextReceived();
+    return gapend != MAX_DATANUMBER;
 }
 
 bool DemoTransportCtl::OnGetByteRate(uint32_t& playbyterate)
 {
     // bytes per second
-    return false;
+    if (m_tansDlTkInfo.m_byterate != std::numeric_limits<uint32_t>::max() && m_tansDlTkInfo.m_byterate != 0)
+    {
+        playbyterate = m_tansDlTkInfo.m_byterate;
+    }
+    else
+    {
+        playbyterate = m_transCtlConfig->playByteRate;
+    }
+    return playbyterate != 0;
 }
 
 void DemoTransportCtl::OnRequestDownloadPieces(uint32_t maxpiececnt)
@@ -356,6 +472,74 @@ void DemoTransportCtl::OnRequestDownloadPieces(uint32_t maxpiececnt)
     }
 }
 
+bool DemoTransportCtl::HasUnrequestedPieces()
+{
+    if (m_tansDlTkInfo.m_filelength == std::numeric_limits<uint64_t>::max())
+    {
+        // file length unknown, more pieces may come
+        return true;
+    }
+    return m_addedPieceEnd * kDataPieceSize < m_tansDlTkInfo.m_filelength;
+}
+
+void DemoTransportCtl::ServicePacedSessions()
+{
+    if (!m_sessStreamCtlConfig.pacingEnabled)
+    {
+        return;
+    }
+    for (auto&& id_sess: m_sessStreamCtlMap)
+    {
+        if (id_sess.second && id_sess.second->TimeUntilNextSend().IsZero())
+        {
+            m_multipathscheduler->DoSinglePathSchedule(id_sess.first);
+        }
+    }
+}
+
+void DemoTransportCtl::UpdateBottleneckGroups()
+{
+    const SharedBottleneckConfig& sbdConfig = m_transCtlConfig->sharedBottleneckConfig;
+    Timepoint now = Clock::GetClock()->Now();
+    if (!sbdConfig.enabled || now < m_lastGroupingTic + sbdConfig.interval)
+    {
+        return;
+    }
+    m_lastGroupingTic = now;
+    std::map<fw::ID, SbdSummary> summaries;
+    for (auto&& sessStreamItor: m_sessStreamCtlMap)
+    {
+        summaries[sessStreamItor.first] = sessStreamItor.second->GetDelaySummary();
+    }
+    std::map<fw::ID, uint32_t> groups = m_sbDetector.Group(summaries);
+    std::map<uint32_t, uint32_t> groupSizes;
+    for (auto&& id_group: groups)
+    {
+        ++groupSizes[id_group.second];
+    }
+    for (auto&& id_group: groups)
+    {
+        m_sessStreamCtlMap[id_group.first]->SetBottleneckGroup(id_group.second, groupSizes[id_group.second]);
+    }
+}
+
+CongestionCtlAlgo* DemoTransportCtl::NewCongestionCtl()
+{
+    switch (m_transCtlConfig->congestionCtlType)
+    {
+        case CongestionCtlType::cubic:
+            return new CubicCongestionContrl(cubicConfig);
+        case CongestionCtlType::bbr:
+            return new BbrCongestionContrl(m_transCtlConfig->bbrConfig);
+        case CongestionCtlType::coupled:
+            return new CoupledCongestionContrl(m_transCtlConfig->coupledConfig, m_coupledCoordinator);
+        case CongestionCtlType::copa:
+            return new CopaCongestionContrl(m_transCtlConfig->copaConfig);
+        default:
+            return new RenoCongestionContrl(renoccConfig);
+    }
+}
+
 std::shared_ptr<MPDTransportController>
 DemoTransportCtlFactory::MakeTransportController(std::shared_ptr<TransPortControllerConfig> ctlConfig)
 {
@@ -8,6 +8,13 @@
 #include "congestioncontrol.hpp"
 #include "sessionstreamcontroller.hpp"
 #include "rrmultipathscheduler.hpp"
+#include "deadlinemultipathscheduler.hpp"
+#include "stripemultipathscheduler.hpp"
+#include "ecfmultipathscheduler.hpp"
+#include "congestioncontrol/cubic.hpp"
+#include "congestioncontrol/bbr.hpp"
+#include "congestioncontrol/coupled.hpp"
+#include "congestioncontrol/copa.hpp"
 
 
 struct DemoTransportCtlConfig : public TransPortControllerConfig
@@ -20,6 +27,27 @@ public:
     uint32_t maxWnd{ 64 };
     uint32_t minWnd{ 1 };
     uint32_t slowStartThreshold{ 32 };
+    CongestionCtlType congestionCtlType{ CongestionCtlType::reno };
+    BbrCongestionCtlConfig bbrConfig;
+    CoupledCongestionCtlConfig coupledConfig;
+    CopaCongestionCtlConfig copaConfig;
+    uint32_t playByteRate{ 1024 * 1024 / 8 };/// bytes per second, used when the task doesn't carry one
+    MultiPathSchedulerType multipathSchedulerType{ MultiPathSchedulerType::MULTI_PATH_SCHEDULE_RR };
+    DeadlineSchedulerConfig deadlineSchedulerConfig;
+    StripeSchedulerConfig stripeSchedulerConfig;
+    EcfSchedulerConfig ecfSchedulerConfig;
+    EndgameConfig endgameConfig;
+    OppRetransConfig oppRetransConfig;
+    SessionHealthConfig sessionHealthConfig;
+    LossDetectionType lossDetectType{ LossDetectionType::rto };
+    bool pacingEnabled{ false };/// always on with bbr
+    uint32_t pacingBurstQuantum{ 2 };
+    double pacingGain{ 1.25 };
+    bool spuriousLossUndo{ true };
+    bool hystartEnabled{ true };/// HyStart++ slow start exit of cubic
+    bool prrEnabled{ true };/// proportional rate reduction in loss recovery
+    SharedBottleneckConfig sharedBottleneckConfig;
+    LossDifferentiationConfig lossDifferentiationConfig;/// random losses are retransmitted without a window cut
 
     std::string DebugInfo();
 };
@@ -105,6 +133,8 @@ public:
 
     void OnPiecePktTimeout(const basefw::ID& peerid, const std::vector<int32_t>& spns) override;
 
+    void OnPieceSpuriousLoss(const basefw::ID& peerid, int32_t spn) override;
+
     bool DoSendDataRequest(const basefw::ID& peerid, const std::vector<int32_t>& spns) override;
 
     //Multipath scheduler handlers
@@ -113,21 +143,43 @@ public:
 
     bool OnGetCurrCachePos(uint64_t& currcachepos) override;
 
+    bool OnGetHeadOfLineGap(DataNumber& gapstart, DataNumber& gapend) override;
+
     bool OnGetByteRate(uint32_t& playbyterate) override;
 
     void OnRequestDownloadPieces(uint32_t maxpiececnt) override;
 
+    bool HasUnrequestedPieces() override;
+
 private:
+    /// the sdk has no timer to wake a paced session up, so paced sessions are polled on each event
+    void ServicePacedSessions();
+
+    /// create the congestion controller of a new session, as chosen by the config
+    CongestionCtlAlgo* NewCongestionCtl();
+
+    /// group the sessions by shared bottleneck from their delay statistics, once per interval
+    void UpdateBottleneckGroups();
 
     bool isRunning{ false };
     TransportDownloadTaskInfo m_tansDlTkInfo;/// task info, rid,filelength, etc
     std::shared_ptr<DemoTransportCtlConfig> m_transCtlConfig;/// transport module config
     std::unique_ptr<MultiPathSchedulerAlgo> m_multipathscheduler;/// multipath scheduler
     std::weak_ptr<MPDTransCtlHandler> m_transctlHandler; // transport module call back
-    std::set<DataNumber> m_downloadPieces;/// main task download queue
-    std::set<DataNumber> m_lostPiecesl;/// lost packets will be stored here till retransmission
+    PieceWindow m_downloadPieces;/// main task download queue
+    PieceWindow m_lostPiecesl;/// lost packets will be stored here till retransmission
+    PieceTable m_pieceTable;/// the state of each piece, updated by the scheduler as pieces are requested
     RenoCongestionCtlConfig renoccConfig;/// congestion config file
+    CubicCongestionCtlConfig cubicConfig;
+    /// shared by the sessions with coupled congestion control
+    std::shared_ptr<CoupledWindowCoordinator> m_coupledCoordinator{ std::make_shared<CoupledWindowCoordinator>() };
     std::map<basefw::ID, std::shared_ptr<SessionStreamController>> m_sessStreamCtlMap;/// map session id to sessionstream
+    SessionStreamCtlConfig m_sessStreamCtlConfig;/// config passed to each sessionstream
+    Timepoint m_firstSentTic{ Timepoint::Zero() };/// playback is assumed to start with the first data request
+    ReceiveBitmap m_recvBitmap;/// the contiguous received part and the pieces received beyond it
+    uint64_t m_addedPieceEnd{ 0 };/// the task has handed over pieces up to m_addedPieceEnd
+    SharedBottleneckDetector m_sbDetector;/// groups the sessions behind the same bottleneck
+    Timepoint m_lastGroupingTic{ Timepoint::Zero() };
 };
 
 /** @class A demo TransportController used to create DemoTransportCtl
@@ -0,0 +1,206 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include "rrmultipathscheduler.hpp"
+
+/// config for EcfMultiPathScheduler
+struct EcfSchedulerConfig {
+    double hysteresis{ 0.25 };/** once a piece is held, the free session has to be this much faster to be used*/
+    Duration maxHold{ Duration::FromMilliseconds(200) };/** a piece held longer goes to any session with free window*/
+};
+
+/// Earliest completion first multipath scheduler, after ECF and BLEST.
+/// Each piece goes to the session expected to deliver it first. A session is expected to deliver the next piece
+/// handed to it one srtt plus rttvar after it has sent the pieces ahead of it, a cwnd per srtt. If a busy session
+/// still beats every session with free window, the piece is held back for it instead of being sent on a slow path
+/// right away, where it would arrive after the pieces behind it. Pieces are never held longer than maxHold.
+class EcfMultiPathScheduler : public RRMultiPathScheduler {
+public:
+    MultiPathSchedulerType SchedulerType() override {
+        return MultiPathSchedulerType::MULTI_PATH_SCHEDULE_ECF;
+    }
+
+    explicit EcfMultiPathScheduler(const fw::ID &taskid,
+                                   std::map<fw::ID, fw::shared_ptr<SessionStreamController>> &dlsessionmap,
+                                   PieceWindow &downloadQueue, PieceWindow &lostPiecesQueue,
+                                   PieceTable &pieceTable,
+                                   const EcfSchedulerConfig &config,
+                                   const EndgameConfig &endgameConfig = EndgameConfig(),
+                                   const OppRetransConfig &oppRetransConfig = OppRetransConfig(),
+                                   const SessionHealthConfig &healthConfig = SessionHealthConfig())
+            : RRMultiPathScheduler(taskid, dlsessionmap, downloadQueue, lostPiecesQueue, pieceTable,
+                                   endgameConfig.maxDuplicateBytes),
+              m_config(config) {
+        SPDLOG_DEBUG("taskid :{}, hysteresis: {}", taskid.ToLogStr(), m_config.hysteresis);
+        EnableEndgame(endgameConfig);
+        EnableOppRetrans(oppRetransConfig);
+        EnableSessionHealth(healthConfig);
+    }
+
+    ~EcfMultiPathScheduler() override {
+        SPDLOG_TRACE("");
+    }
+
+    uint32_t DoSinglePathSchedule(const fw::ID &sessionid) override {
+        SPDLOG_DEBUG("session:{}", sessionid.ToLogStr());
+
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor == m_dlsessionmap.end() || !session_itor->second) {
+            SPDLOG_WARN("Unknown session: {}", sessionid.ToLogStr());
+            return -1;
+        }
+
+        MergeLostPieces();
+
+        if (session_itor->second->CanRequestPktCnt() == 0) {
+            SPDLOG_TRACE("Free Wnd equals to 0");
+            return -1;
+        }
+        auto uni32DataReqCnt = SchedulableCnt(sessionid, session_itor->second);
+
+        if (m_downloadQueue.size() < uni32DataReqCnt) {
+            auto handler = m_phandler.lock();
+            if (handler) {
+                handler->OnRequestDownloadPieces(uni32DataReqCnt - m_downloadQueue.size());
+            } else {
+                SPDLOG_ERROR("handler = null");
+            }
+        }
+
+        // only this session has free window, the others may still be worth waiting for
+        std::map<basefw::ID, uint32_t> toSendinEachSession{ { sessionid, uni32DataReqCnt } };
+        AssignSessionTasks(toSendinEachSession);
+
+        DoSendSessionSubTask(sessionid);
+        return 0;
+    }
+
+protected:
+    void AssignSessionTasks(std::map<basefw::ID, uint32_t> &toSendinEachSession) override {
+        Timepoint now = Clock::GetClock()->Now();
+        for (auto itr = m_heldSince.begin(); itr != m_heldSince.end();) {
+            itr = m_downloadQueue.Contains(itr->first) ? std::next(itr) : m_heldSince.erase(itr);
+        }
+
+        // 1. the state of every session, free window only for the ones served in this pass
+        std::vector<SessionSlot> slots;
+        uint32_t totalFreeCnt = 0;
+        uint32_t maxHoldCnt = 0;
+        for (auto &&itor: m_dlsessionmap) {
+            auto &sessStream = itor.second;
+            if (!sessStream || IsQuarantined(itor.first)) {
+                continue;
+            }
+            SessionSlot slot;
+            slot.sessId = itor.first;
+            auto &&id_sendcnt = toSendinEachSession.find(itor.first);
+            slot.freeCnt = id_sendcnt != toSendinEachSession.end() ? id_sendcnt->second : 0;
+            slot.srttUs = ExpectedRtt(sessStream).ToMicroseconds();
+            slot.rttvarUs = sessStream->GetRttVar().ToMicroseconds();
+            slot.cwnd = std::max(sessStream->GetCWND(), 1U);
+            slot.aheadCnt = sessStream->GetInFlightPktNum() + m_session_needdownloadpieceQ[itor.first].size();
+            // a paced session out of tokens still has window, it only sends a little later
+            Duration untilSend = sessStream->TimeUntilNextSend();
+            slot.busy = untilSend == Duration::Infinite() || slot.aheadCnt >= slot.cwnd;
+            slot.waitUs = slot.busy || slot.freeCnt > 0 ? 0 : untilSend.ToMicroseconds();
+
+            auto &&waiting = m_waitingFor.find(itor.first);
+            if (waiting != m_waitingFor.end() && waiting->second != slot.srttUs) {
+                m_waitingFor.erase(waiting);
+            }
+
+            totalFreeCnt += slot.freeCnt;
+            maxHoldCnt += slot.cwnd;
+            slots.emplace_back(slot);
+        }
+        if (slots.empty() || totalFreeCnt == 0) {
+            return;
+        }
+
+        // 2. in ascending order, each piece goes to the free session delivering it first, or waits for a busy one
+        uint32_t holdCnt = 0;
+        for (auto itr = m_downloadQueue.begin(); itr != m_downloadQueue.end() && totalFreeCnt > 0 &&
+                                                 holdCnt < maxHoldCnt;) {
+            DataNumber pno = *itr++;
+            SessionSlot *fastestFree = nullptr;
+            SessionSlot *fastestBusy = nullptr;
+            SessionSlot *fastestReady = nullptr;
+            for (auto &&slot: slots) {
+                SessionSlot *&fastest = slot.busy ? fastestBusy : fastestFree;
+                if (!fastest || slot.CompletionUs() < fastest->CompletionUs()) {
+                    fastest = &slot;
+                }
+                if (slot.freeCnt > 0 && (!fastestReady || slot.CompletionUs() < fastestReady->CompletionUs())) {
+                    fastestReady = &slot;
+                }
+            }
+
+            SessionSlot *target = fastestFree;
+            if (fastestBusy) {
+                double waitFactor = 1.0 + (m_waitingFor.count(fastestBusy->sessId) ? m_config.hysteresis : 0.0);
+                if (!fastestFree || fastestBusy->CompletionUs() < waitFactor * fastestFree->CompletionUs()) {
+                    target = fastestBusy;
+                }
+            }
+
+            auto &&held = m_heldSince.find(pno);
+            bool overdue = held != m_heldSince.end() && now - held->second >= m_config.maxHold;
+            if (target->freeCnt == 0 && !overdue) {
+                // the piece stays in the download queue, and the session will be asked first next time
+                SPDLOG_TRACE("hold piece {} for session {}", pno, target->sessId.ToLogStr());
+                ++target->aheadCnt;
+                ++holdCnt;
+                if (target->busy) {
+                    m_waitingFor[target->sessId] = target->srttUs;
+                }
+                m_heldSince.emplace(pno, now);
+                continue;
+            }
+            if (target->freeCnt == 0) {
+                SPDLOG_DEBUG("piece {} held for too long, sent on session {}", pno, fastestReady->sessId.ToLogStr());
+                target = fastestReady;
+            }
+
+            target->pieces.push_back(pno);
+            --target->freeCnt;
+            ++target->aheadCnt;
+            --totalFreeCnt;
+            m_downloadQueue.Erase(pno);
+            m_heldSince.erase(pno);
+            if (fastestBusy && target != fastestBusy) {
+                m_waitingFor.erase(fastestBusy->sessId);
+            }
+        }
+
+        for (auto &&slot: slots) {
+            if (!slot.pieces.empty()) {
+                SPDLOG_TRACE("session {} gets pieces {}", slot.sessId.ToLogStr(), slot.pieces);
+                m_session_needdownloadpieceQ[slot.sessId].Insert(slot.pieces.begin(), slot.pieces.end());
+            }
+        }
+    }
+
+private:
+    struct SessionSlot {
+        fw::ID sessId;
+        uint32_t freeCnt{ 0 };
+        bool busy{ false };/** no window left, the next piece waits for an ack*/
+        int64_t waitUs{ 0 };/** until the pacer lets a session with window but no tokens send*/
+        int64_t srttUs{ 0 };
+        int64_t rttvarUs{ 0 };
+        uint32_t cwnd{ 1 };
+        uint32_t aheadCnt{ 0 };/** pieces in flight or queued before the next piece handed to this session*/
+        std::vector<DataNumber> pieces;
+
+        /// the next piece handed to this session is sent after the ones ahead of it, a cwnd per srtt
+        double CompletionUs() const {
+            return waitUs + (1.0 + double(aheadCnt) / cwnd) * srttUs + rttvarUs;
+        }
+    };
+
+    EcfSchedulerConfig m_config;
+    std::map<fw::ID, int64_t> m_waitingFor;/** busy sessions a piece was last held for, with their srtt back then*/
+    std::map<DataNumber, Timepoint> m_heldSince;/** when each piece still in the download queue was first held*/
+};
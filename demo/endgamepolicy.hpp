@@ -0,0 +1,167 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "basefw/base/hash.h"
+#include "basefw/base/log.h"
+#include "utils/sharedbottleneck.hpp"
+#include "utils/transporttime.h"
+#include "packettype.h"
+
+/// config of the end game, see EndgamePolicy
+struct EndgameConfig {
+    bool enabled{ true };
+    uint64_t maxDuplicateBytes{ 256 * 1024 };/** cap on the bytes requested twice, get_score.py charges them in alpha*/
+};
+
+/// Pieces requested on more than one session at once, and the budget of bytes such copies may take.
+/// The first copy to arrive wins, the others are cancelled.
+class DuplicateCopies {
+public:
+    explicit DuplicateCopies(uint64_t maxBytes) : m_maxBytes(maxBytes) {
+    }
+
+    /// @return true if one more piece may be duplicated
+    bool HasBudget() const {
+        return m_bytes + kDataPieceSize <= m_maxBytes;
+    }
+
+    bool Contains(DataNumber pno) const {
+        return m_copies.find(pno) != m_copies.end();
+    }
+
+    /// the piece in flight on original is requested again on copy, out of the budget
+    void Add(DataNumber pno, const fw::ID &original, const fw::ID &copy) {
+        m_copies[pno] = { original, copy };
+        m_bytes += kDataPieceSize;
+    }
+
+    /// a copy of the piece has arrived
+    /// @return the other sessions the piece is still requested on
+    std::set<fw::ID> OnArrived(const fw::ID &sessionid, DataNumber pno) {
+        std::set<fw::ID> others;
+        auto &&copy_itor = m_copies.find(pno);
+        if (copy_itor != m_copies.end()) {
+            others.swap(copy_itor->second);
+            others.erase(sessionid);
+            m_copies.erase(copy_itor);
+        }
+        return others;
+    }
+
+    /// the copy of the piece on the session is lost
+    /// @return true if another copy is still in flight, so that the piece doesn't need to be retransmitted
+    bool OnLost(const fw::ID &sessionid, DataNumber pno) {
+        auto &&copy_itor = m_copies.find(pno);
+        if (copy_itor == m_copies.end() || copy_itor->second.erase(sessionid) == 0) {
+            return false;
+        }
+        bool othersInFlight = !copy_itor->second.empty();
+        if (copy_itor->second.size() < 2) {
+            m_copies.erase(copy_itor);
+        }
+        return othersInFlight;
+    }
+
+    /// the session is gone, the pieces left on a single session aren't duplicates anymore
+    void OnSessionDestroy(const fw::ID &sessionid) {
+        for (auto copy_itor = m_copies.begin(); copy_itor != m_copies.end();) {
+            copy_itor->second.erase(sessionid);
+            copy_itor = copy_itor->second.size() > 1 ? std::next(copy_itor) : m_copies.erase(copy_itor);
+        }
+    }
+
+    /// the pieces queued on the session couldn't be sent, they are back in the download queue
+    void OnSendFailed(const fw::ID &sessionid) {
+        for (auto copy_itor = m_copies.begin(); copy_itor != m_copies.end();) {
+            copy_itor = copy_itor->second.count(sessionid) > 0 ? m_copies.erase(copy_itor) : std::next(copy_itor);
+        }
+    }
+
+    void clear() {
+        m_copies.clear();
+        m_bytes = 0;
+    }
+
+private:
+    uint64_t m_maxBytes;
+    uint64_t m_bytes{ 0 };/** bytes duplicated so far*/
+    std::map<DataNumber, std::set<fw::ID>> m_copies;/** duplicated pieces, to the sessions they are in flight*/
+};
+
+/// a session with free window in the end game
+struct EndgameSlot {
+    fw::ID sessId;
+    uint32_t freeCnt;
+    Duration rtt;
+    uint32_t bottleneckGroup;
+};
+
+/// a piece in flight which may be duplicated in the end game
+struct Straggler {
+    Timepoint expectedArrival;
+    DataNumber pno;
+    fw::ID sessId;
+    uint32_t bottleneckGroup;
+};
+
+/// End game: once every piece of the task has been requested, the pieces in flight expected to arrive last are
+/// duplicated onto the sessions with free window, if those are expected to deliver them earlier.
+class EndgamePolicy {
+public:
+    /// the fastest slot which beats the copy in flight gets the duplicate, preferably one which isn't behind the same
+    /// bottleneck, where the copy would be held up the same way. The duplicates are added to copies.
+    /// @return the pieces to queue, each with the session it is duplicated on
+    std::vector<std::pair<DataNumber, fw::ID>> Plan(std::vector<EndgameSlot> &slots,
+                                                    std::vector<Straggler> &stragglers, DuplicateCopies &copies,
+                                                    Timepoint now) const {
+        std::vector<std::pair<DataNumber, fw::ID>> duplicates;
+        std::sort(slots.begin(), slots.end(), [](const EndgameSlot &a, const EndgameSlot &b) {
+            return a.rtt < b.rtt;
+        });
+        // the latest expected arrival first
+        std::sort(stragglers.begin(), stragglers.end(), [](const Straggler &a, const Straggler &b) {
+            return a.expectedArrival > b.expectedArrival || (a.expectedArrival == b.expectedArrival && a.pno < b.pno);
+        });
+
+        for (auto &&straggler: stragglers) {
+            if (!copies.HasBudget()) {
+                break;
+            }
+            if (copies.Contains(straggler.pno)) {
+                continue;
+            }
+            EndgameSlot *chosen = nullptr;
+            for (auto &&slot: slots) {
+                if (slot.freeCnt == 0 || slot.sessId == straggler.sessId) {
+                    continue;
+                }
+                if (now + slot.rtt >= straggler.expectedArrival) {
+                    // the slots are sorted, no one else can do better
+                    break;
+                }
+                if (!chosen) {
+                    chosen = &slot;
+                }
+                if (slot.bottleneckGroup == SharedBottleneckDetector::kUnknownGroup ||
+                    slot.bottleneckGroup != straggler.bottleneckGroup) {
+                    chosen = &slot;
+                    break;
+                }
+            }
+            if (!chosen) {
+                continue;
+            }
+            --chosen->freeCnt;
+            copies.Add(straggler.pno, straggler.sessId, chosen->sessId);
+            duplicates.emplace_back(straggler.pno, chosen->sessId);
+            SPDLOG_DEBUG("endgame: piece {} from session {} duplicated on session {}", straggler.pno,
+                         straggler.sessId.ToLogStr(), chosen->sessId.ToLogStr());
+        }
+        return duplicates;
+    }
+};
@@ -6,11 +6,17 @@
 #include "basefw/base/hash.h"
 #include "basefw/base/shared_ptr.h"
 #include "sessionstreamcontroller.hpp"
+#include "utils/piecewindow.hpp"
+#include "utils/piecetable.hpp"
+#include "utils/receivebitmap.hpp"
 
 enum MultiPathSchedulerType
 {
     MULTI_PATH_SCHEDULE_NONE = 0,
     MULTI_PATH_SCHEDULE_RR = 1,
+    MULTI_PATH_SCHEDULE_DEADLINE = 2,
+    MULTI_PATH_SCHEDULE_STRIPE = 3,
+    MULTI_PATH_SCHEDULE_ECF = 4,
 };
 
 class MultiPathSchedulerHandler
@@ -20,10 +26,16 @@ public:
 
     virtual bool OnGetCurrCachePos(uint64_t& currcachepos) = 0;
 
+    // pieces in [gapstart, gapend) are missing right after the contiguous part, gapend is the lowest piece received
+    // beyond it. false if nothing has been received beyond the contiguous part
+    virtual bool OnGetHeadOfLineGap(DataNumber& gapstart, DataNumber& gapend) = 0;
+
     virtual bool OnGetByteRate(uint32_t& playbyterate) = 0; // bytes per second
 
     virtual void OnRequestDownloadPieces(uint32_t maxsubpiececnt) = 0; // ask for more subpieces
 
+    virtual bool HasUnrequestedPieces() = 0; // the task still has pieces not handed to transport layer
+
     virtual ~MultiPathSchedulerHandler() = default;
 };
 
@@ -32,9 +44,9 @@ class MultiPathSchedulerAlgo
 public:
     explicit MultiPathSchedulerAlgo(const fw::ID& taskid,
             std::map<fw::ID, fw::shared_ptr<SessionStreamController>>& dlsessionmap,
-            std::set<DataNumber>& downloadQueue, std::set<int32_t>& lostPiecesQueue)
+            PieceWindow& downloadQueue, PieceWindow& lostPiecesQueue, PieceTable& pieceTable)
             : m_taskid(taskid), m_dlsessionmap(dlsessionmap),
-              m_downloadQueue(downloadQueue), m_lostPiecesQueue(lostPiecesQueue)
+              m_downloadQueue(downloadQueue), m_lostPiecesQueue(lostPiecesQueue), m_pieceTable(pieceTable)
     {
     }
 
@@ -55,14 +67,30 @@ public:
 
     virtual void DoMultiPathSchedule() = 0;
 
+    /// called on each loss detection alarm, before DoMultiPathSchedule, for the checks that don't have to run on
+    /// every schedule pass
+    virtual void OnLossDetectionAlarm()
+    {
+    }
+
     virtual uint32_t DoSinglePathSchedule(const fw::ID& sessionid) = 0;
 
     virtual void OnTimedOut(const fw::ID& sessionid, const std::vector<int32_t>& spns) = 0;
 
     virtual void OnReceiveSubpieceData(const fw::ID& sessionid, SeqNumber seq, DataNumber pno, Timepoint recvtime) = 0;
 
+    /// a piece reported lost by OnTimedOut has arrived on the session after all
+    virtual void OnSpuriousLoss(const fw::ID& sessionid, DataNumber pno)
+    {
+    }
+
     virtual void SortSession(std::multimap<Duration, fw::shared_ptr<SessionStreamController>>& sortmmap) = 0;
 
+    /// the rtt or free window of a session has changed, so it should be visited by the next schedule pass
+    virtual void OnSessionStateChanged(const fw::ID& sessionid)
+    {
+    }
+
     virtual int32_t DoSendSessionSubTask(const fw::ID& sessionid) = 0;
 
     virtual ~MultiPathSchedulerAlgo() = default;
@@ -70,7 +98,8 @@ public:
 protected:
     fw::ID m_taskid;
     std::map<fw::ID, fw::shared_ptr<SessionStreamController>>& m_dlsessionmap;
-    std::set<DataNumber>& m_downloadQueue; // main task queue
-    std::set<DataNumber>& m_lostPiecesQueue;// the lost pieces queue, waiting to be retransmitted
+    PieceWindow& m_downloadQueue; // main task queue
+    PieceWindow& m_lostPiecesQueue;// the lost pieces queue, waiting to be retransmitted
+    PieceTable& m_pieceTable;// the state of each piece
 };
 
@@ -0,0 +1,100 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include "basefw/base/hash.h"
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+#include "packettype.h"
+
+/// config of the opportunistic retransmission of the head-of-line piece, see OppRetransPolicy
+struct OppRetransConfig {
+    bool enabled{ true };/** the copies come out of the duplicate budget of EndgameConfig*/
+    uint32_t minReorderPieces{ 8 };/** only pieces arriving so far beyond the cache position show a blocked head*/
+    double minShare{ 1.0 };/** the penalty doesn't shrink the share of a session's cwnd below this, 1 for none*/
+};
+
+/// Opportunistic retransmission: a piece arriving far beyond the cache position means the lowest missing piece blocks
+/// the contiguous part. If it's overdue on a slower session, it's requested again on the receiving one. If minShare
+/// allows, the share of cwnd the blocking session may fill is halved, at most once per its rtt, and doubles back each
+/// rtt it isn't penalized.
+class OppRetransPolicy {
+public:
+    explicit OppRetransPolicy(const OppRetransConfig &config) : m_config(config) {
+    }
+
+    /// @return true if the arrival of pno shows that hol, the lowest missing piece, blocks the contiguous part
+    bool IsHeadBlocked(DataNumber pno, DataNumber hol) const {
+        return pno >= hol + static_cast<DataNumber>(m_config.minReorderPieces);
+    }
+
+    /// reordering within the rtt variation of the blocking session is expected, and a request sent again on the
+    /// blocking session would take an rtt at least
+    /// @return true if hol, last requested at lastRequest on the blocking session, should be requested again on the
+    /// receiving session
+    bool ShouldRetransmit(Timepoint lastRequest, Duration blockingRtt, Duration blockingRttVar, Duration receivingRtt,
+                          Timepoint now) const {
+        return now >= lastRequest + blockingRtt + blockingRttVar && receivingRtt < blockingRtt;
+    }
+
+    /// halve the share of cwnd the session may fill, at most once per rtt
+    void Penalize(const fw::ID &sessionid, Duration rtt, Timepoint now) {
+        if (m_config.minShare >= 1.0) {
+            return;
+        }
+        auto &&penalty_itor = m_sessionPenalty.find(sessionid);
+        if (penalty_itor == m_sessionPenalty.end()) {
+            penalty_itor = m_sessionPenalty.emplace(sessionid, SessionPenalty{ 1.0, now }).first;
+        } else if (now - penalty_itor->second.stamp < rtt) {
+            return;
+        }
+        penalty_itor->second.share = std::max(m_config.minShare, penalty_itor->second.share / 2);
+        penalty_itor->second.stamp = now;
+        SPDLOG_DEBUG("session {} penalized, share: {}", sessionid.ToLogStr(), penalty_itor->second.share);
+    }
+
+    /// double the share back each rtt without penalty
+    void Restore(const fw::ID &sessionid, Duration rtt, Timepoint now) {
+        auto &&penalty_itor = m_sessionPenalty.find(sessionid);
+        if (penalty_itor == m_sessionPenalty.end() || now - penalty_itor->second.stamp < rtt) {
+            return;
+        }
+        penalty_itor->second.share *= 2;
+        penalty_itor->second.stamp = now;
+        if (penalty_itor->second.share >= 1.0) {
+            m_sessionPenalty.erase(penalty_itor);
+        }
+    }
+
+    bool IsPenalized(const fw::ID &sessionid) const {
+        return m_sessionPenalty.find(sessionid) != m_sessionPenalty.end();
+    }
+
+    /// @return the pieces the session may have in flight or queued, out of limit
+    uint32_t Limit(const fw::ID &sessionid, uint32_t limit) const {
+        auto &&penalty_itor = m_sessionPenalty.find(sessionid);
+        if (penalty_itor == m_sessionPenalty.end()) {
+            return limit;
+        }
+        return std::max(1U, static_cast<uint32_t>(penalty_itor->second.share * limit));
+    }
+
+    void OnSessionDestroy(const fw::ID &sessionid) {
+        m_sessionPenalty.erase(sessionid);
+    }
+
+    void clear() {
+        m_sessionPenalty.clear();
+    }
+
+private:
+    struct SessionPenalty {
+        double share;/** share of cwnd the session may fill*/
+        Timepoint stamp;/** when the share was last changed*/
+    };
+
+    OppRetransConfig m_config;
+    std::map<fw::ID, SessionPenalty> m_sessionPenalty;/** penalized sessions only*/
+};
@@ -5,9 +5,12 @@ using SeqNumber = uint32_t;
 using DataNumber = int32_t;
 #define MAX_SEQNUMBER std::numeric_limits<uint32_t>::max()
 #define MAX_DATANUMBER std::numeric_limits<int32_t>::max()
+/// each data piece carries 1KB payload
+constexpr uint32_t kDataPieceSize = 1024;
 
 #include <sstream>
-#include <map>
+#include <vector>
+#include <algorithm>
 
 struct DataPacket
 {
@@ -17,9 +20,19 @@ struct DataPacket
     virtual ~DataPacket() = default;
 };
 
+/// delivery state of a session taken when a packet is sent, used to compute the delivery rate when it's acked
+struct DeliveryState
+{
+    uint64_t delivered{ 0 };/** bytes delivered on the session so far*/
+    Timepoint deliveredTic{ Timepoint::Zero() };/** when delivered was last updated*/
+    Timepoint firstSentTic{ Timepoint::Zero() };/** send time of the packet which started the sampling interval*/
+    bool isAppLimited{ false };/** sent while the session had free window but nothing to request*/
+};
+
 struct InflightPacket : DataPacket
 {
     Timepoint sendtic{ Timepoint::Zero() };
+    DeliveryState sentState;
 
     friend std::ostream& operator<<(std::ostream& os, const InflightPacket& pkt)
     {
@@ -62,42 +75,81 @@ struct AckedPacket : InflightPacket
     }
 };
 
+/// plain record of a packet in flight, stored inside InFlightPacketMap
+struct InflightEntry
+{
+    SeqNumber seq{ MAX_SEQNUMBER };
+    DataNumber pieceId{ MAX_DATANUMBER };
+    Timepoint sendtic{ Timepoint::Zero() };
+    DeliveryState sentState;
+    SeqNumber prevSeq{ MAX_SEQNUMBER };/** previous packet in flight, in sequence order*/
+    SeqNumber nextSeq{ MAX_SEQNUMBER };/** next packet in flight, in sequence order*/
+    bool inflight{ false };
+
+    InflightPacket ToInflightPacket() const
+    {
+        InflightPacket pkt;
+        pkt.seq = seq;
+        pkt.pieceId = pieceId;
+        pkt.sendtic = sendtic;
+        pkt.sentState = sentState;
+        return pkt;
+    }
+};
+
+/// Packets in flight of one session, indexed by sequence number.
+/// Sequence numbers increase monotonically per session, so the entries are kept in a ring buffer at slot
+/// (seq & mask). The packets still in flight are also chained in sequence order, so that loss detection scans
+/// from the oldest one and stops at the first packet which is not lost, skipping acked holes.
 class InFlightPacketMap
 {
 public:
-    void AddSentPacket(DataPacket& p, QuicTime sendtic)
+    InFlightPacketMap() : m_ring(kInitRingSize)
+    {
+    }
+
+    void AddSentPacket(DataPacket& p, QuicTime sendtic, const DeliveryState& sentState = DeliveryState())
     {
-        InflightPacket inflightPacket;
-        inflightPacket.seq = p.seq;
-        inflightPacket.pieceId = p.pieceId;
-        inflightPacket.sendtic = sendtic;
-        auto&& itor_pair = inflightPktMap.emplace(std::make_pair(p.seq, p.pieceId), inflightPacket);
-        if (!itor_pair.second)
+        if (FindEntry(p.seq))
         {
             SPDLOG_WARN("insert failed with seq = {},duplicate pkt?", p.seq);
+            return;
         }
-        else
+        // the ring has to cover every seq from the oldest in flight one to this one
+        if (m_inflightCnt > 0)
         {
-            if (p.seq > maxSeqInflightPkt.seq)
-            {
-                maxSeqInflightPkt = inflightPacket;
-            }
-            SPDLOG_DEBUG("Add pkt with seq = {}, max inflight {}, max acked {}", p.seq,
-                    MaxSeqInflightPkt().DebugInfo(), MaxSeqAckedPkt().DebugInfo());
+            SeqNumber lowest = std::min(m_oldestSeq, p.seq);
+            SeqNumber highest = std::max(m_newestSeq, p.seq);
+            Reserve(static_cast<size_t>(highest - lowest) + 1);
         }
+        InflightEntry& entry = m_ring[p.seq & (m_ring.size() - 1)];
+        entry = InflightEntry();
+        entry.seq = p.seq;
+        entry.pieceId = p.pieceId;
+        entry.sendtic = sendtic;
+        entry.sentState = sentState;
+        entry.inflight = true;
+        LinkEntry(entry);
+        ++m_inflightCnt;
 
+        if (maxSeqInflightPkt.seq == MAX_SEQNUMBER || p.seq > maxSeqInflightPkt.seq)
+        {
+            maxSeqInflightPkt = entry.ToInflightPacket();
+        }
+        SPDLOG_DEBUG("Add pkt with seq = {}, max inflight {}, max acked {}", p.seq,
+                MaxSeqInflightPkt().DebugInfo(), MaxSeqAckedPkt().DebugInfo());
         SPDLOG_TRACE("Sent seq:{}, map now:{}", p.seq, DebugInfo());
     }
 
     void OnPacktReceived(InflightPacket& p, QuicTime recvtic)
     {
-        auto&& itor = inflightPktMap.find(std::make_pair(p.seq, p.pieceId));
-        if (itor != inflightPktMap.end())
+        InflightEntry* entry = FindEntry(p.seq);
+        if (entry)
         {
-            inflightPktMap.erase(std::make_pair(p.seq, p.pieceId));
+            UnlinkEntry(*entry);
             SPDLOG_DEBUG("recv pkt with seq = {}, max inflight {}, max acked {}", p.seq,
                     MaxSeqInflightPkt().DebugInfo(), MaxSeqAckedPkt().DebugInfo());
-            if (p.seq > maxSeqAckPkt.seq)
+            if (maxSeqAckPkt.seq == MAX_SEQNUMBER || p.seq > maxSeqAckPkt.seq)
             {
                 AckedPacket ackpkt;
                 ackpkt.seq = p.seq;
@@ -112,17 +164,16 @@ public:
             SPDLOG_WARN("Receive a pkt with unknown seq {}", p.seq);
         }
 
-
         SPDLOG_TRACE("Recv seq:{}, map now:{}", p.seq, DebugInfo());
     }
 
     // packet is marked as lost
     void RemoveFromInFlight(InflightPacket& p)
     {
-        auto&& itor = inflightPktMap.find(std::make_pair(p.seq, p.pieceId));
-        if (itor != inflightPktMap.end())
+        InflightEntry* entry = FindEntry(p.seq);
+        if (entry)
         {
-            inflightPktMap.erase(std::make_pair(p.seq, p.pieceId));
+            UnlinkEntry(*entry);
             SPDLOG_DEBUG("remove pkt with seq = {}, max inflight {}, max acked {}", p.seq,
                     MaxSeqInflightPkt().DebugInfo(), MaxSeqAckedPkt().DebugInfo());
         }
@@ -135,7 +186,7 @@ public:
 
     size_t InFlightPktNum() const
     {
-        return inflightPktMap.size();
+        return m_inflightCnt;
     }
 
     /// return Inflight packet with max sequence number
@@ -156,35 +207,153 @@ public:
     std::pair<bool, InflightPacket> PktIsInFlight(SeqNumber seq, DataNumber dataid = MAX_DATANUMBER)
     {
         std::pair<bool, InflightPacket> rt = std::make_pair(false, InflightPacket());
-        const auto& itor = inflightPktMap.find(std::make_pair(seq, dataid));
-        if (itor != inflightPktMap.end())
+        const InflightEntry* entry = FindEntry(seq);
+        if (entry)
         {
-            if (dataid != MAX_DATANUMBER && dataid != itor->second.pieceId)
+            if (dataid != MAX_DATANUMBER && dataid != entry->pieceId)
             {
                 SPDLOG_WARN("seq {} found, but data id is different. Input dataid: {}, found dataid:{}",
-                        seq, dataid, itor->second.pieceId);
+                        seq, dataid, entry->pieceId);
             }
             rt.first = true;
-            rt.second = itor->second;
+            rt.second = entry->ToInflightPacket();
         }
         SPDLOG_TRACE("seq:{}", seq);
         return rt;
     }
 
+    /// the packet in flight with the smallest sequence number, nullptr if none
+    const InflightEntry* OldestInFlight() const
+    {
+        return m_inflightCnt > 0 ? FindEntry(m_oldestSeq) : nullptr;
+    }
+
+    /// visit packets in flight from the oldest one, stop as soon as visitor returns false
+    template<class Visitor>
+    void ForEachFromOldest(Visitor visitor) const
+    {
+        const InflightEntry* entry = OldestInFlight();
+        while (entry && visitor(*entry))
+        {
+            entry = entry->nextSeq == MAX_SEQNUMBER ? nullptr : FindEntry(entry->nextSeq);
+        }
+    }
+
     std::string DebugInfo() const
     {
         std::stringstream ss;
         ss << " { ";
-        for (const auto& itor: inflightPktMap)
-        {
-            ss << itor.second;
-        }
+        ForEachFromOldest([&ss](const InflightEntry& entry) {
+            ss << entry.ToInflightPacket();
+            return true;
+        });
         ss << " } ";
         return ss.str();
     }
 
     AckedPacket maxSeqAckPkt;
     InflightPacket maxSeqInflightPkt;
-    using InFlKeyType = std::pair<SeqNumber, DataNumber>;
-    std::map<InFlKeyType, InflightPacket> inflightPktMap;
+
+private:
+    static constexpr size_t kInitRingSize = 256;
+
+    InflightEntry* FindEntry(SeqNumber seq)
+    {
+        InflightEntry& entry = m_ring[seq & (m_ring.size() - 1)];
+        return entry.inflight && entry.seq == seq ? &entry : nullptr;
+    }
+
+    const InflightEntry* FindEntry(SeqNumber seq) const
+    {
+        const InflightEntry& entry = m_ring[seq & (m_ring.size() - 1)];
+        return entry.inflight && entry.seq == seq ? &entry : nullptr;
+    }
+
+    /// grow the ring so that span consecutive sequence numbers map to distinct slots
+    void Reserve(size_t span)
+    {
+        if (span <= m_ring.size())
+        {
+            return;
+        }
+        size_t newSize = m_ring.size();
+        while (newSize < span)
+        {
+            newSize <<= 1U;
+        }
+        std::vector<InflightEntry> newRing(newSize);
+        for (auto&& entry: m_ring)
+        {
+            if (entry.inflight)
+            {
+                newRing[entry.seq & (newSize - 1)] = entry;
+            }
+        }
+        m_ring.swap(newRing);
+        SPDLOG_DEBUG("inflight ring grows to {}", newSize);
+    }
+
+    /// chain a new entry in sequence order, normally at the tail
+    void LinkEntry(InflightEntry& entry)
+    {
+        if (m_inflightCnt == 0)
+        {
+            m_oldestSeq = entry.seq;
+            m_newestSeq = entry.seq;
+            return;
+        }
+        SeqNumber prev = m_newestSeq;
+        while (prev != MAX_SEQNUMBER && prev > entry.seq)
+        {
+            prev = FindEntry(prev)->prevSeq;
+        }
+        entry.prevSeq = prev;
+        if (prev == MAX_SEQNUMBER)
+        {
+            entry.nextSeq = m_oldestSeq;
+            FindEntry(m_oldestSeq)->prevSeq = entry.seq;
+            m_oldestSeq = entry.seq;
+        }
+        else
+        {
+            InflightEntry* prevEntry = FindEntry(prev);
+            entry.nextSeq = prevEntry->nextSeq;
+            prevEntry->nextSeq = entry.seq;
+            if (entry.nextSeq == MAX_SEQNUMBER)
+            {
+                m_newestSeq = entry.seq;
+            }
+            else
+            {
+                FindEntry(entry.nextSeq)->prevSeq = entry.seq;
+            }
+        }
+    }
+
+    void UnlinkEntry(InflightEntry& entry)
+    {
+        if (entry.prevSeq == MAX_SEQNUMBER)
+        {
+            m_oldestSeq = entry.nextSeq;
+        }
+        else
+        {
+            FindEntry(entry.prevSeq)->nextSeq = entry.nextSeq;
+        }
+        if (entry.nextSeq == MAX_SEQNUMBER)
+        {
+            m_newestSeq = entry.prevSeq;
+        }
+        else
+        {
+            FindEntry(entry.nextSeq)->prevSeq = entry.prevSeq;
+        }
+        entry.inflight = false;
+        --m_inflightCnt;
+    }
+
+    std::vector<InflightEntry> m_ring;/** size is a power of 2*/
+    size_t m_inflightCnt{ 0 };
+    SeqNumber m_oldestSeq{ MAX_SEQNUMBER };
+    SeqNumber m_newestSeq{ MAX_SEQNUMBER };
 };
\ No newline at end of file
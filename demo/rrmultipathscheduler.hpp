@@ -3,14 +3,23 @@
 #pragma once
 
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <set>
 #include "basefw/base/log.h"
 #include "multipathschedulerI.h"
+#include "endgamepolicy.hpp"
+#include "oppretranspolicy.hpp"
+#include "sessionhealthpolicy.hpp"
 #include <numeric>
 
-
-/// min RTT Round Robin multipath scheduler
+/// min RTT Round Robin multipath scheduler.
+/// Sessions are kept ordered by rtt, and the order is only updated when a session reports a state change. A multipath
+/// schedule pass visits only the pending sessions: the ones changed since the last pass, and the hungry ones which
+/// still had free window when the pieces ran out.
+/// The end game, the opportunistic retransmission and the session health tracking are policies the scheduler owns
+/// if their configs enable them. The subclasses pick the policies they use with the Enable* calls.
 class RRMultiPathScheduler : public MultiPathSchedulerAlgo {
 public:
     MultiPathSchedulerType SchedulerType() override {
@@ -19,9 +28,16 @@ public:
 
     explicit RRMultiPathScheduler(const fw::ID &taskid,
                                   std::map<fw::ID, fw::shared_ptr<SessionStreamController>> &dlsessionmap,
-                                  std::set<DataNumber> &downloadQueue, std::set<int32_t> &lostPiecesQueue)
-            : MultiPathSchedulerAlgo(taskid, dlsessionmap, downloadQueue, lostPiecesQueue) {
-        SPDLOG_DEBUG("taskid :{}", taskid.ToLogStr());
+                                  PieceWindow &downloadQueue, PieceWindow &lostPiecesQueue,
+                                  PieceTable &pieceTable,
+                                  const EndgameConfig &endgameConfig = EndgameConfig(),
+                                  const OppRetransConfig &oppRetransConfig = OppRetransConfig(),
+                                  const SessionHealthConfig &healthConfig = SessionHealthConfig())
+            : RRMultiPathScheduler(taskid, dlsessionmap, downloadQueue, lostPiecesQueue, pieceTable,
+                                   endgameConfig.maxDuplicateBytes) {
+        EnableEndgame(endgameConfig);
+        EnableOppRetrans(oppRetransConfig);
+        EnableSessionHealth(healthConfig);
     }
 
     ~RRMultiPathScheduler() override {
@@ -45,38 +61,59 @@ public:
         auto &&itor = m_session_needdownloadpieceQ.find(sessionid);
         if (itor != m_session_needdownloadpieceQ.end()) {// found, clear the sending queue
             SPDLOG_WARN("Session: {} is already created", sessionid.ToLogStr());
-            for (auto &&subpiecetask: itor->second) {
-                m_downloadQueue.emplace(subpiecetask);
-            }
+            m_downloadQueue.Insert(itor->second);
         }
-        m_session_needdownloadpieceQ[sessionid] = std::set<int32_t>();
-
+        m_session_needdownloadpieceQ[sessionid].clear();
+        if (m_health) {
+            m_health->OnSessionCreate(sessionid);
+        }
+        OnSessionStateChanged(sessionid);
     }
 
     void OnSessionDestory(const fw::ID &sessionid) override {
         SPDLOG_DEBUG("session: {}", sessionid.ToLogStr());
-        // find the session's queue, clear the subpieces and add the subpieces to main downloading queue
+        // find the session's queue, the queued and in flight pieces are retransmitted first by the next schedule pass
         auto &&itor = m_session_needdownloadpieceQ.find(sessionid);
         if (itor == m_session_needdownloadpieceQ.end()) {
             SPDLOG_WARN("Session: {} isn't in session queue", sessionid.ToLogStr());
             return;
         }
-        for (auto &&subpiecetask: itor->second) {
-            m_downloadQueue.emplace(subpiecetask);
-
-        }
+        ReclaimSessionPieces(sessionid);
         m_session_needdownloadpieceQ.erase(itor);
+        m_copies.OnSessionDestroy(sessionid);
+        auto &&score_itor = m_sessionScore.find(sessionid);
+        if (score_itor != m_sessionScore.end()) {
+            m_sessionOrder.erase(std::make_pair(score_itor->second, sessionid));
+            m_sessionScore.erase(score_itor);
+        }
+        m_pendingSessions.erase(sessionid);
+        if (m_oppRetrans) {
+            m_oppRetrans->OnSessionDestroy(sessionid);
+        }
+        if (m_health) {
+            m_health->OnSessionDestroy(sessionid);
+        }
     }
 
     void OnResetDownload() override {
         SPDLOG_DEBUG("");
+        m_sessionOrder.clear();
+        m_sessionScore.clear();
+        m_pendingSessions.clear();
+        m_copies.clear();
+        if (m_oppRetrans) {
+            m_oppRetrans->clear();
+        }
+        if (m_health) {
+            m_health->clear();
+        }
 
         if (m_session_needdownloadpieceQ.empty()) {
             return;
         }
         for (auto &it_sn: m_session_needdownloadpieceQ) {
             if (!it_sn.second.empty()) {
-                m_downloadQueue.insert(it_sn.second.begin(), it_sn.second.end());
+                m_downloadQueue.Insert(it_sn.second);
 
                 it_sn.second.clear();
             }
@@ -91,14 +128,19 @@ public:
             return;
         }
 
-        // sort session first
-        SPDLOG_TRACE("DoMultiPathSchedule");
-        SortSession(m_sortmmap);
-        // send pkt requests on each session based on ascend order;
+        SPDLOG_TRACE("DoMultiPathSchedule, pending sessions: {}", m_pendingSessions.size());
+        // send pkt requests on each pending session based on ascend order;
         FillUpSessionTask();
 
     }
 
+    /// the health checks visit every session, they run on the alarm rather than on each schedule pass
+    void OnLossDetectionAlarm() override {
+        Timepoint now = Clock::GetClock()->Now();
+        CheckSessionSilence(now);
+        DoProbeSchedule(now);
+    }
+
 
     uint32_t DoSinglePathSchedule(const fw::ID &sessionid) override {
         SPDLOG_DEBUG("session:{}", sessionid.ToLogStr());
@@ -110,14 +152,17 @@ public:
             return -1;
         }
 
+        // pieces found lost on ack are retransmitted right away
+        MergeLostPieces();
+
         auto& session = session_itor->second;
-        auto uni32DataReqCnt = session->CanRequestPktCnt();
-        SPDLOG_DEBUG("Free Wnd : {}", uni32DataReqCnt);
-        // try to find how many pieces of data we should fill in sub-task queue;
-        if (uni32DataReqCnt == 0) {
+        SPDLOG_DEBUG("Free Wnd : {}", session->CanRequestPktCnt());
+        if (session->CanRequestPktCnt() == 0) {
             SPDLOG_WARN("Free Wnd equals to 0");
             return -1;
         }
+        // try to find how many pieces of data we should fill in sub-task queue, the queued ones are sent first;
+        auto uni32DataReqCnt = SchedulableCnt(sessionid, session);
 
         if (m_downloadQueue.size() < uni32DataReqCnt) {
             auto handler = m_phandler.lock();
@@ -129,16 +174,12 @@ public:
         }
 
         /// Add task to session task queue
-        std::vector<int32_t> vecSubpieceNums;
+        auto &sessionQueue = m_session_needdownloadpieceQ[sessionid];
         // eject uni32DataReqCnt number of subpieces from
-        for (auto itr = m_downloadQueue.begin(); itr != m_downloadQueue.end() && uni32DataReqCnt > 0;) {
-            vecSubpieceNums.push_back(*itr);
-            m_downloadQueue.erase(itr++);
-            --uni32DataReqCnt;
+        for (; !m_downloadQueue.empty() && uni32DataReqCnt > 0; --uni32DataReqCnt) {
+            sessionQueue.Insert(m_downloadQueue.PopLowest());
         }
 
-        m_session_needdownloadpieceQ[sessionid].insert(vecSubpieceNums.begin(), vecSubpieceNums.end());
-
         ////////////////////////////////////DoSendRequest
         DoSendSessionSubTask(sessionid);
         return 0;
@@ -147,11 +188,25 @@ public:
     void OnTimedOut(const fw::ID &sessionid, const std::vector<int32_t> &pns) override {
         SPDLOG_DEBUG("session {},lost pieces {}", sessionid.ToLogStr(), pns);
         for (auto &pidx: pns) {
-            auto &&itor_pair = m_lostPiecesQueue.emplace(pidx);
-            if (!itor_pair.second) {
+            if (DropProbeCopy(sessionid, pidx)) {
+                continue;
+            }
+            if (m_copies.OnLost(sessionid, pidx)) {
+                SPDLOG_DEBUG("pieceId {} is still in flight on another session", pidx);
+                continue;
+            }
+            if (m_pieceTable.State(pidx) == PieceState::received) {
+                SPDLOG_DEBUG("pieceId {} has been received on another session", pidx);
+                continue;
+            }
+            if (!m_lostPiecesQueue.Insert(pidx)) {
                 SPDLOG_WARN(" pieceId {} already marked lost", pidx);
             }
+            m_pieceTable.OnRequeued(pidx);
         }
+        OnSessionTimeout(sessionid, Clock::GetClock()->Now());
+        // the lost pieces leave the window
+        OnSessionStateChanged(sessionid);
     }
 
     void OnReceiveSubpieceData(const fw::ID &sessionid, SeqNumber seq, DataNumber pno, Timepoint recvtime) override {
@@ -159,73 +214,176 @@ public:
                      sessionid.ToLogStr(), seq, pno, recvtime.ToDebuggingValue());
         /// rx and tx signal are forwarded directly from transport controller to session controller
 
+        if (m_health) {
+            m_health->OnAnswered(sessionid, recvtime);
+        }
+        OnSessionStateChanged(sessionid);
+        CancelEndgameCopies(sessionid, pno);
+        RestoreSessionShare(sessionid, recvtime);
+        DoOpportunisticRetransmit(sessionid, pno, recvtime);
         DoSinglePathSchedule(sessionid);
+        SettlePendingSession(sessionid);
+        DoEndgameSchedule();
+    }
+
+    void OnSpuriousLoss(const fw::ID &sessionid, DataNumber pno) override {
+        // drop the retransmission if it's still queued, stop waiting for it if it has been sent
+        bool dequeued = m_lostPiecesQueue.Erase(pno);
+        dequeued = m_downloadQueue.Erase(pno) || dequeued;
+        for (auto &&id_ssQ: m_session_needdownloadpieceQ) {
+            dequeued = id_ssQ.second.Erase(pno) || dequeued;
+        }
+        CancelEndgameCopies(sessionid, pno);
+        uint32_t cancelled = 0;
+        for (auto &&id_session: m_dlsessionmap) {
+            uint32_t sessCancelled = id_session.second ? id_session.second->CancelInFlightPiece(pno) : 0;
+            if (sessCancelled > 0) {
+                cancelled += sessCancelled;
+                OnSessionStateChanged(id_session.first);
+            }
+        }
+        SPDLOG_DEBUG("session:{}, piece {} wasn't lost, retransmission dequeued:{}, cancelled:{}",
+                     sessionid.ToLogStr(), pno, dequeued, cancelled);
     }
 
     void SortSession(std::multimap<Duration, fw::shared_ptr<SessionStreamController>> &sortmmap) override {
-        //TODO this does not sort the session
         SPDLOG_TRACE("");
         sortmmap.clear();
-        for (auto &&sessionItor: m_dlsessionmap) {
-            auto score = sessionItor.second->GetRtt();
-            sortmmap.emplace(score, sessionItor.second);
+        for (auto &&score_id: m_sessionOrder) {
+            auto &&session_itor = m_dlsessionmap.find(score_id.second);
+            if (session_itor != m_dlsessionmap.end() && session_itor->second) {
+                sortmmap.emplace(score_id.first, session_itor->second);
+            }
+        }
+    }
+
+    void OnSessionStateChanged(const fw::ID &sessionid) override {
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor == m_dlsessionmap.end() || !session_itor->second) {
+            return;
+        }
+        m_pendingSessions.insert(sessionid);
+
+        // move the session to its new place only if the score has changed
+        auto score = session_itor->second->GetRtt();
+        auto &&score_itor = m_sessionScore.find(sessionid);
+        if (score_itor != m_sessionScore.end()) {
+            if (score_itor->second == score) {
+                return;
+            }
+            m_sessionOrder.erase(std::make_pair(score_itor->second, sessionid));
+            score_itor->second = score;
+        } else {
+            m_sessionScore.emplace(sessionid, score);
         }
+        m_sessionOrder.emplace(score, sessionid);
+    }
+
+protected:
+    /// for the subclasses, which enable the policies they use themselves
+    RRMultiPathScheduler(const fw::ID &taskid, std::map<fw::ID, fw::shared_ptr<SessionStreamController>> &dlsessionmap,
+                         PieceWindow &downloadQueue, PieceWindow &lostPiecesQueue, PieceTable &pieceTable,
+                         uint64_t maxDuplicateBytes)
+            : MultiPathSchedulerAlgo(taskid, dlsessionmap, downloadQueue, lostPiecesQueue, pieceTable),
+              m_copies(maxDuplicateBytes) {
+        SPDLOG_DEBUG("taskid :{}, maxDuplicateBytes: {}", taskid.ToLogStr(), maxDuplicateBytes);
+    }
+
+    void EnableEndgame(const EndgameConfig &config) {
+        SPDLOG_DEBUG("endgame: {}", config.enabled);
+        m_endgame.reset(config.enabled ? new EndgamePolicy() : nullptr);
+    }
+
+    void EnableOppRetrans(const OppRetransConfig &config) {
+        SPDLOG_DEBUG("oppRetrans: {}, minReorderPieces: {}, minShare: {}", config.enabled, config.minReorderPieces,
+                     config.minShare);
+        m_oppRetrans.reset(config.enabled ? new OppRetransPolicy(config) : nullptr);
+    }
 
+    void EnableSessionHealth(const SessionHealthConfig &config) {
+        SPDLOG_DEBUG("health: {}", config.enabled);
+        m_health.reset(config.enabled ? new SessionHealthPolicy(config) : nullptr);
     }
 
-private:
     int32_t DoSendSessionSubTask(const fw::ID &sessionid) override {
         SPDLOG_TRACE("session id: {}", sessionid.ToLogStr());
         int32_t i32Result = -1;
-        auto &setNeedDlSubpiece = m_session_needdownloadpieceQ[sessionid];
+        auto &&queue_itor = m_session_needdownloadpieceQ.find(sessionid);
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (queue_itor == m_session_needdownloadpieceQ.end() || session_itor == m_dlsessionmap.end() ||
+            !session_itor->second) {
+            SPDLOG_WARN("Unknown session: {}", sessionid.ToLogStr());
+            return i32Result;
+        }
+        auto &setNeedDlSubpiece = queue_itor->second;
+        auto &session = session_itor->second;
         if (setNeedDlSubpiece.empty()) {
             SPDLOG_TRACE("empty sending queue");
+            if (session->CanRequestPktCnt() > 0) {
+                session->OnAppLimited();
+            }
             return i32Result;
         }
 
-        auto &session = m_dlsessionmap[sessionid];
         uint32_t u32CanSendCnt = session->CanRequestPktCnt();
         std::vector<int32_t> vecSubpieces;
-        for (auto itor = setNeedDlSubpiece.begin();
-             itor != setNeedDlSubpiece.end() && vecSubpieces.size() < u32CanSendCnt;) {
-            vecSubpieces.emplace_back(*itor);
-            setNeedDlSubpiece.erase(itor++);
+        while (!setNeedDlSubpiece.empty() && vecSubpieces.size() < u32CanSendCnt) {
+            DataNumber pno = setNeedDlSubpiece.PopLowest();
+            // a copy queued for a piece which has arrived meanwhile
+            if (m_pieceTable.State(pno) != PieceState::received) {
+                vecSubpieces.emplace_back(pno);
+            }
+        }
+        if (vecSubpieces.empty()) {
+            session->OnAppLimited();
+            return i32Result;
+        }
+        if (vecSubpieces.size() < u32CanSendCnt) {
+            // the delivery rate measured from now on doesn't tell the path capacity
+            session->OnAppLimited();
         }
 
-        bool rt = m_dlsessionmap[sessionid]->DoRequestdata(sessionid, vecSubpieces);
+        bool rt = session->DoRequestdata(sessionid, vecSubpieces);
         if (rt) {
             i32Result = 0;
             //succeed
+            Timepoint now = Clock::GetClock()->Now();
+            for (auto &&pno: vecSubpieces) {
+                m_pieceTable.OnRequested(pno, sessionid, now);
+            }
         } else {
             // fail
             // return sending pieces to main download queue
             SPDLOG_DEBUG("Send failed, Given back");
-            m_downloadQueue.insert(setNeedDlSubpiece.begin(), setNeedDlSubpiece.end());
+            m_downloadQueue.Insert(vecSubpieces.begin(), vecSubpieces.end());
         }
 
         return i32Result;
     }
 
-    void FillUpSessionTask() {
-        // 1. put lost packets back into main download queue
-        SPDLOG_TRACE("");
-        for (auto &&lostpiece: m_lostPiecesQueue) {
-            auto &&itor_pair = m_downloadQueue.emplace(lostpiece);
-            if (itor_pair.second) {
-                SPDLOG_TRACE("lost piece {} inserts successfully", lostpiece);
-            } else {
-                SPDLOG_TRACE("lost piece {} already in task queue", lostpiece);
-            }
+    /// put lost pieces back into main download queue
+    void MergeLostPieces() {
+        if (m_lostPiecesQueue.empty()) {
+            return;
         }
+        SPDLOG_TRACE("lost pieces cnt: {}", m_lostPiecesQueue.size());
+        m_downloadQueue.Insert(m_lostPiecesQueue);
         m_lostPiecesQueue.clear();
+    }
+
+    void FillUpSessionTask() {
+        // 1. put lost packets back into main download queue
+        MergeLostPieces();
 
-        // 2. go through every session,find how many pieces we can request at one time
+        // 2. go through every pending session,find how many pieces we can request at one time
 
         std::map<basefw::ID, uint32_t> toSendinEachSession;
-        for (auto &&itor: m_dlsessionmap) {
-            auto &sessionId = itor.first;
-            auto &sessStream = itor.second;
-            auto sessCanSendCnt = sessStream->CanRequestPktCnt();
+        for (auto &&sessionId: m_pendingSessions) {
+            auto &&session_itor = m_dlsessionmap.find(sessionId);
+            if (session_itor == m_dlsessionmap.end() || !session_itor->second) {
+                continue;
+            }
+            auto sessCanSendCnt = SchedulableCnt(sessionId, session_itor->second);
             toSendinEachSession.emplace(sessionId, sessCanSendCnt);
             if (sessCanSendCnt != 0) {
                 SPDLOG_TRACE("session {} has {} free wnd", sessionId.ToLogStr(), sessCanSendCnt);
@@ -264,55 +422,354 @@ private:
 
         SPDLOG_TRACE(" download queue size: {}, need pieces cnt: {}", m_downloadQueue.size(), totalSubpieceCnt);
 
-        // 4. fill up each session Queue, based on min RTT first order, and send
-        std::vector<DataNumber> vecToSendpieceNums;
-        for (auto &&rtt_sess: m_sortmmap) {
-            auto &sessStream = rtt_sess.second;
-//            auto &&sessId = sessStream->GetSessionId();
-            auto sessId = sessStream->GetSessionId();
+        // 4. fill up each session Queue and send
+        AssignSessionTasks(toSendinEachSession);
+
+        // then send in each session
+        for (auto &&id_sendcnt: toSendinEachSession) {
+            DoSendSessionSubTask(id_sendcnt.first);
+        }
+        for (auto &&id_sendcnt: toSendinEachSession) {
+            SettlePendingSession(id_sendcnt.first);
+        }
+
+        // 5. no piece left to assign, duplicate the stragglers
+        DoEndgameSchedule();
+
+    }// end of FillUpSessionTask
+
+    /// fill up the Queue of each session in toSendinEachSession, based on min RTT first order
+    virtual void AssignSessionTasks(std::map<basefw::ID, uint32_t> &toSendinEachSession) {
+        for (auto &&score_id: m_sessionOrder) {
+            auto &sessId = score_id.second;
+            auto &&id_sendcnt = toSendinEachSession.find(sessId);
+            if (id_sendcnt == toSendinEachSession.end()) {
+                // not pending in this pass
+                continue;
+            }
             auto &&itor_id_ssQ = m_session_needdownloadpieceQ.find(sessId);
             if (itor_id_ssQ != m_session_needdownloadpieceQ.end()) {
-                auto &&id_sendcnt = toSendinEachSession.find(sessId);
-                if (id_sendcnt != toSendinEachSession.end()) {
-                    auto uni32DataReqCnt = toSendinEachSession.at(sessId);
-                    for (auto &&itr = m_downloadQueue.begin();
-                         itr != m_downloadQueue.end() && uni32DataReqCnt > 0;) {
+                auto uni32DataReqCnt = id_sendcnt->second;
+                for (; !m_downloadQueue.empty() && uni32DataReqCnt > 0; --uni32DataReqCnt) {
+                    itor_id_ssQ->second.Insert(m_downloadQueue.PopLowest());
+                }
+            } else {
+                SPDLOG_ERROR("Can't found Session:{} in session_needdownloadsubpiece", sessId.ToLogStr());
+            }
+        }
+    }
+
+    /// after the session has been served, it stays pending only if it's hungry, i.e. still has free window
+    void SettlePendingSession(const fw::ID &sessionid) {
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor == m_dlsessionmap.end() || !session_itor->second ||
+            SchedulableCnt(sessionid, session_itor->second) == 0) {
+            m_pendingSessions.erase(sessionid);
+        } else {
+            m_pendingSessions.insert(sessionid);
+        }
+    }
 
-                        vecToSendpieceNums.push_back(*itr);
-                        m_downloadQueue.erase(itr++);
-                        --uni32DataReqCnt;
+    /// @return true if every piece has been requested, and the task has nothing more to add
+    bool NoUnassignedPieces() {
+        // the pending pieces are the ones in the download, lost and session queues
+        if (m_pieceTable.Count(PieceState::pending) > 0) {
+            return false;
+        }
+        auto handler = m_phandler.lock();
+        return handler && !handler->HasUnrequestedPieces();
+    }
 
-                    }
+    /// duplicate the pieces expected to arrive last onto the sessions expected to deliver them earlier
+    void DoEndgameSchedule() {
+        if (!m_endgame || !m_copies.HasBudget() || !NoUnassignedPieces()) {
+            return;
+        }
 
-                    m_session_needdownloadpieceQ[sessId].insert(vecToSendpieceNums.begin(),
-                                                                vecToSendpieceNums.end());
-                    vecToSendpieceNums.clear();
-                } else {
-                    SPDLOG_ERROR("Can't found session {} in toSendinEachSession", sessId.ToLogStr());
+        // 1. sessions with free window
+        std::vector<EndgameSlot> slots;
+        for (auto &&score_id: m_sessionOrder) {
+            auto &&session_itor = m_dlsessionmap.find(score_id.second);
+            if (session_itor == m_dlsessionmap.end() || !session_itor->second) {
+                continue;
+            }
+            uint32_t freeCnt = SchedulableCnt(score_id.second, session_itor->second);
+            if (freeCnt > 0) {
+                slots.push_back(EndgameSlot{ score_id.second, freeCnt, ExpectedRtt(session_itor->second),
+                                             session_itor->second->GetBottleneckGroup() });
+            }
+        }
+        if (slots.empty()) {
+            return;
+        }
+
+        // 2. pieces in flight not duplicated yet. An overdue piece is likely lost, it has to be detected lost and
+        // requested again before it arrives.
+        Timepoint now = Clock::GetClock()->Now();
+        std::vector<Straggler> stragglers;
+        for (auto &&id_session: m_dlsessionmap) {
+            if (!id_session.second) {
+                continue;
+            }
+            const fw::ID &sessId = id_session.first;
+            Duration rtt = ExpectedRtt(id_session.second);
+            uint32_t bottleneckGroup = id_session.second->GetBottleneckGroup();
+            id_session.second->ForEachInFlightPacket([&](const InflightEntry &entry) {
+                if (!m_copies.Contains(entry.pieceId)) {
+                    Timepoint expectedArrival = entry.sendtic + rtt;
+                    if (expectedArrival <= now) {
+                        expectedArrival = now + rtt + rtt;
+                    }
+                    stragglers.push_back(Straggler{ expectedArrival, entry.pieceId, sessId, bottleneckGroup });
                 }
+                return true;
+            });
+        }
 
+        // 3. queue the duplicates and send
+        std::set<fw::ID> sendSessions;
+        for (auto &&pno_sessId: m_endgame->Plan(slots, stragglers, m_copies, now)) {
+            m_session_needdownloadpieceQ[pno_sessId.second].Insert(pno_sessId.first);
+            sendSessions.insert(pno_sessId.second);
+        }
+        for (auto &&sessId: sendSessions) {
+            if (DoSendSessionSubTask(sessId) != 0) {
+                // the pieces are back in the download queue, they are not duplicates anymore
+                m_copies.OnSendFailed(sessId);
+            }
+            SettlePendingSession(sessId);
+        }
+    }
 
-            } else {
-                SPDLOG_ERROR("Can't found Session:{} in session_needdownloadsubpiece", sessId.ToLogStr());
+    /// the first copy of a duplicated piece has arrived, stop waiting for the others
+    void CancelEndgameCopies(const fw::ID &sessionid, DataNumber pno) {
+        for (auto &&sessId: m_copies.OnArrived(sessionid, pno)) {
+            auto &&queue_itor = m_session_needdownloadpieceQ.find(sessId);
+            if (queue_itor != m_session_needdownloadpieceQ.end()) {
+                queue_itor->second.Erase(pno);
+            }
+            auto &&session_itor = m_dlsessionmap.find(sessId);
+            if (session_itor != m_dlsessionmap.end() && session_itor->second &&
+                session_itor->second->CancelInFlightPiece(pno) > 0) {
+                OnSessionStateChanged(sessId);
             }
         }
+    }
 
-        // then send in each session
-        for (auto &&it_sn = m_session_needdownloadpieceQ.begin();
-             it_sn != m_session_needdownloadpieceQ.end(); ++it_sn) {
-//            auto &sessId = it_sn->first;
-//            auto &sessQueue = it_sn->second;
-//            SPDLOG_TRACE("session Id:{}, session queue:{}", sessId.ToLogStr(), sessQueue);
-            DoSendSessionSubTask(it_sn->first);
+    /// @return how many more pieces the session may be given: its free window less its queue, within the limits of
+    /// its health and its share of cwnd
+    uint32_t SchedulableCnt(const fw::ID &sessionid, const fw::shared_ptr<SessionStreamController> &session) {
+        uint32_t freeCnt = session->CanRequestPktCnt();
+        auto &&queue_itor = m_session_needdownloadpieceQ.find(sessionid);
+        uint32_t queued = queue_itor != m_session_needdownloadpieceQ.end() ? queue_itor->second.size() : 0;
+        freeCnt = freeCnt > queued ? freeCnt - queued : 0;
+        bool penalized = m_oppRetrans && m_oppRetrans->IsPenalized(sessionid);
+        bool healthy = !m_health || m_health->IsHealthy(sessionid);
+        if (freeCnt == 0 || (healthy && !penalized)) {
+            return freeCnt;
         }
 
+        uint32_t limit = session->GetCWND();
+        if (penalized) {
+            limit = m_oppRetrans->Limit(sessionid, limit);
+        }
+        if (!healthy) {
+            // a quarantined session gets probes only, see DoProbeSchedule
+            limit = m_health->Limit(sessionid, limit);
+        }
+        uint32_t used = session->GetInFlightPktNum() + queued;
+        return used >= limit ? 0 : std::min(freeCnt, limit - used);
+    }
 
-    }// end of FillUpSessionTask
+    /// @return true if the session only gets probes
+    bool IsQuarantined(const fw::ID &sessionid) const {
+        return m_health && m_health->IsQuarantined(sessionid);
+    }
+
+    /// a piece arriving far beyond the cache position may show a blocked head, request it again on this session
+    void DoOpportunisticRetransmit(const fw::ID &sessionid, DataNumber pno, Timepoint now) {
+        if (!m_oppRetrans || !m_copies.HasBudget()) {
+            return;
+        }
+        auto handler = m_phandler.lock();
+        DataNumber hol = 0;
+        DataNumber gapend = 0;
+        if (!handler || !handler->OnGetHeadOfLineGap(hol, gapend) || !m_oppRetrans->IsHeadBlocked(pno, hol) ||
+            m_copies.Contains(hol)) {
+            return;
+        }
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor == m_dlsessionmap.end() || !session_itor->second ||
+            session_itor->second->CanRequestPktCnt() == 0) {
+            return;
+        }
+
+        // the session the head-of-line piece was last requested on
+        const PieceRecord *record = m_pieceTable.State(hol) == PieceState::inflight ? m_pieceTable.Record(hol)
+                                                                                     : nullptr;
+        if (!record || record->sessions.empty() || record->sessions.back() == sessionid) {
+            return;
+        }
+        fw::ID blockingId = record->sessions.back();
+        auto &&blocking_itor = m_dlsessionmap.find(blockingId);
+        if (blocking_itor == m_dlsessionmap.end() || !blocking_itor->second) {
+            return;
+        }
+        Duration blockingRtt = ExpectedRtt(blocking_itor->second);
+        if (!m_oppRetrans->ShouldRetransmit(record->lastRequest, blockingRtt, blocking_itor->second->GetRttVar(),
+                                            ExpectedRtt(session_itor->second), now)) {
+            return;
+        }
+
+        // the lowest piece goes out first on the next send of this session
+        m_session_needdownloadpieceQ[sessionid].Insert(hol);
+        m_copies.Add(hol, blockingId, sessionid);
+        SPDLOG_DEBUG("head-of-line piece {} from session {} retransmitted on session {}", hol,
+                     blockingId.ToLogStr(), sessionid.ToLogStr());
+        m_oppRetrans->Penalize(blockingId, blockingRtt, now);
+    }
+
+    /// the penalized share of the session doubles back each rtt without penalty
+    void RestoreSessionShare(const fw::ID &sessionid, Timepoint now) {
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (m_oppRetrans && session_itor != m_dlsessionmap.end() && session_itor->second) {
+            m_oppRetrans->Restore(sessionid, ExpectedRtt(session_itor->second), now);
+        }
+    }
+
+    void OnSessionTimeout(const fw::ID &sessionid, Timepoint now) {
+        if (m_health && m_health->OnTimeout(sessionid)) {
+            QuarantineSession(sessionid, now);
+        }
+    }
+
+    /// quarantine the sessions which have had pieces in flight without receiving anything for too long
+    void CheckSessionSilence(Timepoint now) {
+        if (!m_health) {
+            return;
+        }
+        std::vector<fw::ID> silentSessions;
+        for (auto &&id_session: m_dlsessionmap) {
+            if (!id_session.second) {
+                continue;
+            }
+            Timepoint oldestSent{ Timepoint::Zero() };
+            id_session.second->ForEachInFlightPacket([&oldestSent](const InflightEntry &entry) {
+                oldestSent = entry.sendtic;
+                return false;
+            });
+            if (oldestSent.IsInitialized() &&
+                m_health->IsSilent(id_session.first, oldestSent, ExpectedRtt(id_session.second), now)) {
+                silentSessions.push_back(id_session.first);
+            }
+        }
+        for (auto &&sessId: silentSessions) {
+            QuarantineSession(sessId, now);
+        }
+    }
+
+    /// hand all the pieces of the session back to be scheduled on the others, it only gets probes from now on
+    void QuarantineSession(const fw::ID &sessionid, Timepoint now) {
+        m_health->Quarantine(sessionid, now);
+        ReclaimSessionPieces(sessionid);
+        OnSessionStateChanged(sessionid);
+    }
+
+    /// send a copy of the lowest piece in flight on another session to each quarantined session whose probe is due.
+    /// If nothing is in flight, the lowest piece to be downloaded is the probe.
+    void DoProbeSchedule(Timepoint now) {
+        if (!m_health) {
+            return;
+        }
+        for (auto &&sessId: m_health->DueProbes(now)) {
+            auto &&session_itor = m_dlsessionmap.find(sessId);
+            if (session_itor == m_dlsessionmap.end() || !session_itor->second ||
+                session_itor->second->CanRequestPktCnt() == 0) {
+                continue;
+            }
+            DataNumber probe = MAX_DATANUMBER;
+            for (auto &&id_session: m_dlsessionmap) {
+                if (!id_session.second || id_session.first == sessId) {
+                    continue;
+                }
+                id_session.second->ForEachInFlightPacket([&probe](const InflightEntry &entry) {
+                    probe = std::min(probe, entry.pieceId);
+                    return true;
+                });
+            }
+            bool isCopy = probe != MAX_DATANUMBER;
+            if (!isCopy && m_downloadQueue.empty()) {
+                continue;
+            }
+            if (!isCopy) {
+                probe = m_downloadQueue.PopLowest();
+            }
+
+            m_session_needdownloadpieceQ[sessId].Insert(probe);
+            if (DoSendSessionSubTask(sessId) != 0 && isCopy) {
+                // given back to the download queue, but the piece is still in flight on another session
+                m_downloadQueue.Erase(probe);
+                isCopy = false;
+            }
+            m_health->OnProbeSent(sessId, probe, isCopy, now);
+        }
+    }
+
+    /// @return true if the piece lost on the session was a copy sent as a probe, which needn't be retransmitted
+    bool DropProbeCopy(const fw::ID &sessionid, DataNumber pno) {
+        return m_health && m_health->DropProbeCopy(sessionid, pno);
+    }
+
+    /// move the queued and in flight pieces of the session to the lost queue, unless another copy is in flight
+    /// @return the number of pieces moved
+    uint32_t ReclaimSessionPieces(const fw::ID &sessionid) {
+        std::vector<DataNumber> pieces;
+        auto &&queue_itor = m_session_needdownloadpieceQ.find(sessionid);
+        if (queue_itor != m_session_needdownloadpieceQ.end()) {
+            while (!queue_itor->second.empty()) {
+                pieces.push_back(queue_itor->second.PopLowest());
+            }
+        }
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor != m_dlsessionmap.end() && session_itor->second) {
+            std::vector<DataNumber> inflight;
+            session_itor->second->ForEachInFlightPacket([&inflight](const InflightEntry &entry) {
+                inflight.push_back(entry.pieceId);
+                return true;
+            });
+            for (auto &&pno: inflight) {
+                session_itor->second->CancelInFlightPiece(pno);
+                pieces.push_back(pno);
+            }
+        }
+        uint32_t reclaimed = 0;
+        for (auto &&pno: pieces) {
+            if (!DropProbeCopy(sessionid, pno) && !m_copies.OnLost(sessionid, pno) &&
+                m_pieceTable.State(pno) != PieceState::received && m_lostPiecesQueue.Insert(pno)) {
+                m_pieceTable.OnRequeued(pno);
+                ++reclaimed;
+            }
+        }
+        SPDLOG_DEBUG("session {}: {} pieces reclaimed", sessionid.ToLogStr(), reclaimed);
+        return reclaimed;
+    }
+
+    static Duration ExpectedRtt(const fw::shared_ptr<SessionStreamController> &session) {
+        Duration rtt = session->GetRtt();
+        // the initial rtt of a session without rtt sample
+        return rtt.IsZero() ? Duration::FromMilliseconds(200) : rtt;
+    }
 
-    /// It's multipath scheduler's duty to maintain session_needdownloadsubpiece, and m_sortmmap
-    std::map<fw::ID, std::set<DataNumber>> m_session_needdownloadpieceQ;// session task queues
-    std::multimap<Duration, fw::shared_ptr<SessionStreamController>> m_sortmmap;
+    /// It's multipath scheduler's duty to maintain session_needdownloadsubpiece, and the session order
+    std::map<fw::ID, PieceWindow> m_session_needdownloadpieceQ;// session task queues
+    std::set<std::pair<Duration, fw::ID>> m_sessionOrder;/** sessions in ascending rtt order*/
+    std::map<fw::ID, Duration> m_sessionScore;/** the rtt each session is ordered by*/
+    std::set<fw::ID> m_pendingSessions;/** sessions to be visited by the next multipath schedule pass*/
     fw::weak_ptr<MultiPathSchedulerHandler> m_phandler;
+    DuplicateCopies m_copies;/** pieces copied by the end game, the opportunistic retransmission and the probes*/
+    std::unique_ptr<EndgamePolicy> m_endgame;/** the policies, null if not enabled*/
+    std::unique_ptr<OppRetransPolicy> m_oppRetrans;
+    std::unique_ptr<SessionHealthPolicy> m_health;
 
 };
 
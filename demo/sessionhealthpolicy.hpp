@@ -0,0 +1,167 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "basefw/base/hash.h"
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+#include "packettype.h"
+
+/// config of the session health tracking, see SessionHealthPolicy
+struct SessionHealthConfig {
+    bool enabled{ true };
+    uint32_t suspectTimeouts{ 1 };/** timeout events in a row without a piece received to suspect a session*/
+    uint32_t quarantineTimeouts{ 3 };/** timeout events in a row without a piece received to quarantine it*/
+    uint32_t silenceRtts{ 4 };/** quarantine a session if nothing has been received for so many srtt ...*/
+    Duration minSilence{ Duration::FromMilliseconds(500) };/** ... and at least for so long, with pieces in flight*/
+    Duration initialProbeInterval{ Duration::FromMilliseconds(200) };/** doubled after each probe*/
+    Duration maxProbeInterval{ Duration::FromSeconds(1) };/** bounds the recovery time once the path is back*/
+};
+
+enum class SessionHealth : uint8_t {
+    healthy = 0,
+    suspect = 1,/** may fill only half of its cwnd*/
+    quarantined = 2/** only gets probes, at exponentially growing intervals, until a piece is received*/
+};
+
+/// Session health: a session which times out several times in a row, or stays silent with pieces in flight, is
+/// quarantined. The scheduler hands all its pieces to the other sessions, and until it answers it only gets probes.
+class SessionHealthPolicy {
+public:
+    explicit SessionHealthPolicy(const SessionHealthConfig &config) : m_config(config) {
+    }
+
+    void OnSessionCreate(const fw::ID &sessionid) {
+        m_sessionHealth[sessionid] = SessionHealthState();
+    }
+
+    void OnSessionDestroy(const fw::ID &sessionid) {
+        m_sessionHealth.erase(sessionid);
+    }
+
+    void clear() {
+        m_sessionHealth.clear();
+    }
+
+    /// a piece has arrived on the session, it's healthy again
+    void OnAnswered(const fw::ID &sessionid, Timepoint now) {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        if (health_itor == m_sessionHealth.end()) {
+            return;
+        }
+        auto &state = health_itor->second;
+        if (state.health == SessionHealth::quarantined) {
+            SPDLOG_DEBUG("session {} recovered after {} ms in quarantine", sessionid.ToLogStr(),
+                         (now - state.quarantineStamp).ToMilliseconds());
+        }
+        state.health = SessionHealth::healthy;
+        state.timeoutCnt = 0;
+        state.lastRecvStamp = now;
+        state.probeCopies.clear();
+    }
+
+    /// @return true if the session has timed out too often, and is to be quarantined
+    bool OnTimeout(const fw::ID &sessionid) {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        if (health_itor == m_sessionHealth.end() || health_itor->second.health == SessionHealth::quarantined) {
+            return false;
+        }
+        auto &state = health_itor->second;
+        ++state.timeoutCnt;
+        if (state.timeoutCnt >= m_config.quarantineTimeouts) {
+            return true;
+        }
+        if (state.timeoutCnt >= m_config.suspectTimeouts) {
+            state.health = SessionHealth::suspect;
+        }
+        return false;
+    }
+
+    /// @param oldestSent when the oldest piece in flight on the session was sent
+    /// @return true if nothing has been received on the session for too long, with pieces in flight
+    bool IsSilent(const fw::ID &sessionid, Timepoint oldestSent, Duration rtt, Timepoint now) const {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        if (health_itor == m_sessionHealth.end() || health_itor->second.health == SessionHealth::quarantined) {
+            return false;
+        }
+        Duration silence = now - std::max(oldestSent, health_itor->second.lastRecvStamp);
+        return silence > std::max(m_config.minSilence, rtt * static_cast<int>(m_config.silenceRtts));
+    }
+
+    void Quarantine(const fw::ID &sessionid, Timepoint now) {
+        auto &state = m_sessionHealth[sessionid];
+        state.health = SessionHealth::quarantined;
+        state.quarantineStamp = now;
+        state.probeInterval = m_config.initialProbeInterval;
+        state.nextProbe = now + state.probeInterval;
+        state.probeCopies.clear();
+        SPDLOG_DEBUG("session {} quarantined", sessionid.ToLogStr());
+    }
+
+    bool IsQuarantined(const fw::ID &sessionid) const {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        return health_itor != m_sessionHealth.end() && health_itor->second.health == SessionHealth::quarantined;
+    }
+
+    bool IsHealthy(const fw::ID &sessionid) const {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        return health_itor == m_sessionHealth.end() || health_itor->second.health == SessionHealth::healthy;
+    }
+
+    /// @return the pieces the session may have in flight or queued, out of limit: half if suspect, none if quarantined
+    uint32_t Limit(const fw::ID &sessionid, uint32_t limit) const {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        if (health_itor == m_sessionHealth.end() || health_itor->second.health == SessionHealth::healthy) {
+            return limit;
+        }
+        return health_itor->second.health == SessionHealth::suspect ? std::max(1U, limit / 2) : 0;
+    }
+
+    /// @return the quarantined sessions whose next probe is due
+    std::vector<fw::ID> DueProbes(Timepoint now) const {
+        std::vector<fw::ID> due;
+        for (auto &&id_health: m_sessionHealth) {
+            if (id_health.second.health == SessionHealth::quarantined && now >= id_health.second.nextProbe) {
+                due.push_back(id_health.first);
+            }
+        }
+        return due;
+    }
+
+    /// the probe has been sent on the quarantined session, the next one is sent after twice the interval
+    /// @param isCopy the probe is a copy of a piece in flight on another session
+    void OnProbeSent(const fw::ID &sessionid, DataNumber probe, bool isCopy, Timepoint now) {
+        auto &state = m_sessionHealth[sessionid];
+        if (isCopy) {
+            state.probeCopies.insert(probe);
+        }
+        state.nextProbe = now + state.probeInterval;
+        state.probeInterval = std::min(state.probeInterval * 2, m_config.maxProbeInterval);
+        SPDLOG_DEBUG("probe session {} with piece {}, next probe in {}", sessionid.ToLogStr(), probe,
+                     state.probeInterval.ToDebuggingValue());
+    }
+
+    /// @return true if the piece lost on the session was a copy sent as a probe, which needn't be retransmitted
+    bool DropProbeCopy(const fw::ID &sessionid, DataNumber pno) {
+        auto &&health_itor = m_sessionHealth.find(sessionid);
+        return health_itor != m_sessionHealth.end() && health_itor->second.probeCopies.erase(pno) > 0;
+    }
+
+private:
+    struct SessionHealthState {
+        SessionHealth health{ SessionHealth::healthy };
+        uint32_t timeoutCnt{ 0 };/** timeout events since the last piece received*/
+        Timepoint lastRecvStamp{ Timepoint::Zero() };
+        Timepoint quarantineStamp{ Timepoint::Zero() };
+        Timepoint nextProbe{ Timepoint::Zero() };
+        Duration probeInterval{ Duration::Zero() };
+        std::set<DataNumber> probeCopies;/** probes which are copies of pieces in flight on other sessions*/
+    };
+
+    SessionHealthConfig m_config;
+    std::map<fw::ID, SessionHealthState> m_sessionHealth;
+};
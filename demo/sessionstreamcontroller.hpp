@@ -2,11 +2,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <deque>
 #include <memory>
 #include "congestioncontrol.hpp"
 #include "basefw/base/log.h"
 #include "packettype.h"
+#include "utils/sharedbottleneck.hpp"
 //#include "thirdparty/quiche/quic_types.h"
 
 class SessionStreamCtlHandler
@@ -14,11 +17,17 @@ class SessionStreamCtlHandler
 public:
     virtual void OnPiecePktTimeout(const basefw::ID& peerid, const std::vector<int32_t>& spns) = 0;
 
+    /// a piece reported lost by OnPiecePktTimeout has arrived after all
+    virtual void OnPieceSpuriousLoss(const basefw::ID& peerid, int32_t spn) = 0;
+
     virtual bool DoSendDataRequest(const basefw::ID& peerid, const std::vector<int32_t>& spns) = 0;
 };
 
 /// PacketSender is a simple traffic control module, in TCP or Quic, it is called Pacer.
 /// Decide if we can send pkt at this time
+/// By default it only checks the free window and caps a burst at 8 pieces. In pacing mode, a token bucket
+/// filled at gain * cwnd / srtt, or at the rate given by the congestion controller, releases at most burstQuantum
+/// pieces at once.
 class PacketSender
 {
 public:
@@ -47,6 +56,11 @@ public:
         SPDLOG_TRACE("cwnd:{},downloadingPktCnt:{}", cwnd, downloadingPktCnt);
         if (cwnd >= downloadingPktCnt)
         {
+            if (m_pacing)
+            {
+                auto tokens = static_cast<uint32_t>(std::max(m_tokens, 0.0));
+                return std::min(cwnd - downloadingPktCnt, tokens);
+            }
 //            return std::min(cwnd - downloadingPktCnt, quic::MaxOneTimeSentCount);
             return std::min(cwnd - downloadingPktCnt, 8U);
         }
@@ -56,7 +70,171 @@ public:
         }
     }
 
+    void EnablePacing(uint32_t burstQuantum, double pacingGain)
+    {
+        m_pacing = true;
+        m_burstQuantum = std::max(burstQuantum, 1U);
+        m_pacingGain = pacingGain;
+        m_tokens = m_burstQuantum;
+        SPDLOG_DEBUG("burstQuantum:{}, pacingGain:{}", m_burstQuantum, m_pacingGain);
+    }
+
+    bool IsPacing() const
+    {
+        return m_pacing;
+    }
+
+    /// refill the token bucket up to now, then take the new pacing rate
+    void UpdatePacing(uint32_t cwnd, Duration srtt, Timepoint now, uint64_t pacingRate = 0)
+    {
+        if (!m_pacing)
+        {
+            return;
+        }
+        if (m_lastRefillTic.IsInitialized() && m_lastRefillTic < now)
+        {
+            m_tokens += (now - m_lastRefillTic).ToMicroseconds() * m_pktPerUs;
+            m_tokens = std::min(m_tokens, static_cast<double>(m_burstQuantum));
+        }
+        m_lastRefillTic = now;
+        if (pacingRate > 0)
+        {
+            // the congestion controller has applied its own gain
+            m_pktPerUs = static_cast<double>(pacingRate) / kDataPieceSize / 1000000.0;
+        }
+        else
+        {
+            m_pktPerUs = m_pacingGain * cwnd / std::max(srtt.ToMicroseconds(), int64_t(1));
+        }
+        SPDLOG_TRACE("cwnd:{}, srtt:{}, tokens:{}", cwnd, srtt.ToDebuggingValue(), m_tokens);
+    }
+
+    void OnPktsSent(uint32_t pktcnt)
+    {
+        if (m_pacing)
+        {
+            m_tokens -= pktcnt;
+        }
+    }
+
+    /// @return how long until the next piece may be released, Zero if now
+    Duration TimeUntilSend() const
+    {
+        if (!m_pacing || m_tokens >= 1.0)
+        {
+            return Duration::Zero();
+        }
+        if (m_pktPerUs <= 0)
+        {
+            return Duration::Infinite();
+        }
+        return Duration::FromMicroseconds(static_cast<int64_t>(std::ceil((1.0 - m_tokens) / m_pktPerUs)));
+    }
+
     std::unique_ptr<CongestionCtlAlgo> m_congestAlgo;
+
+private:
+    bool m_pacing{ false };
+    uint32_t m_burstQuantum{ 8 };
+    double m_pacingGain{ 1.0 };
+    double m_tokens{ 0 };/** pieces allowed to be sent now*/
+    double m_pktPerUs{ 0 };/** pacing rate*/
+    Timepoint m_lastRefillTic{ Timepoint::Zero() };
+};
+
+/// ProportionalRateReduction spreads a window reduction over the recovery, RFC 6937.
+/// Cutting the window at once stops the session until the pieces in flight drain below it, about an rtt, then it
+/// sends a burst. Instead, while the pieces in flight are above the target window, requests go out in proportion to
+/// the pieces answered, so that in flight reaches the target as recovery ends. Below the target, the slow start
+/// reduction bound lets it grow back by at most one piece more than answered per ack.
+class ProportionalRateReduction
+{
+public:
+    /// @param flightSize pieces in flight when the loss was found, the lost ones included
+    void OnEnterRecovery(uint32_t flightSize)
+    {
+        m_inRecovery = true;
+        m_recoverFs = std::max(flightSize, 1U);
+        m_prrDelivered = 0;
+        m_prrOut = 0;
+        m_ackAllowance = 0;
+        SPDLOG_DEBUG("RecoverFS:{}", m_recoverFs);
+    }
+
+    void OnExitRecovery()
+    {
+        SPDLOG_DEBUG("prr_delivered:{}, prr_out:{}", m_prrDelivered, m_prrOut);
+        m_inRecovery = false;
+    }
+
+    bool InRecovery() const
+    {
+        return m_inRecovery;
+    }
+
+    void OnPktsAcked(uint32_t pktcnt)
+    {
+        if (m_inRecovery)
+        {
+            m_prrDelivered += pktcnt;
+            m_ackAllowance = pktcnt + 1;
+        }
+    }
+
+    void OnPktsSent(uint32_t pktcnt)
+    {
+        if (m_inRecovery)
+        {
+            m_prrOut += pktcnt;
+            m_ackAllowance = m_ackAllowance > pktcnt ? m_ackAllowance - pktcnt : 0;
+        }
+    }
+
+    /// @return the window the sender may fill now, ssThresh being the window the congestion controller aims at
+    uint32_t SendWindow(uint32_t inFlight, uint32_t ssThresh) const
+    {
+        int64_t sndcnt = 0;
+        if (inFlight > ssThresh)
+        {
+            // proportional rate reduction
+            int64_t target = (m_prrDelivered * ssThresh + m_recoverFs - 1) / m_recoverFs;
+            sndcnt = target - static_cast<int64_t>(m_prrOut);
+        }
+        else
+        {
+            // slow start reduction bound
+            int64_t limit = std::max<int64_t>(static_cast<int64_t>(m_prrDelivered - m_prrOut), m_ackAllowance);
+            sndcnt = std::min<int64_t>(ssThresh - inFlight, limit);
+        }
+        // with nothing in flight no ack will come to release more, keep one request going
+        if (inFlight == 0)
+        {
+            sndcnt = std::max<int64_t>(sndcnt, 1);
+        }
+        return inFlight + static_cast<uint32_t>(std::max<int64_t>(sndcnt, 0));
+    }
+
+private:
+    bool m_inRecovery{ false };
+    uint64_t m_recoverFs{ 1 };/** RecoverFS*/
+    uint64_t m_prrDelivered{ 0 };/** pieces answered since recovery started*/
+    uint64_t m_prrOut{ 0 };/** pieces requested since recovery started*/
+    uint32_t m_ackAllowance{ 0 };/** DeliveredData + 1 of the last ack, less what has been sent since*/
+};
+
+/// config for the modules inside SessionStreamController
+struct SessionStreamCtlConfig
+{
+    LossDetectionType lossDetectType{ LossDetectionType::rto };
+    bool pacingEnabled{ false };/** pace requests instead of sending a burst on each ack*/
+    uint32_t pacingBurstQuantum{ 2 };/** pieces released at once when pacing*/
+    double pacingGain{ 1.25 };/** pacing rate = pacingGain * cwnd / srtt*/
+    bool spuriousLossUndo{ true };/** match late answers to recently lost requests and undo the loss*/
+    uint32_t recentLostCnt{ 256 };/** lost requests remembered at most*/
+    Duration recentLostAge{ Duration::FromSeconds(2) };/** a lost request is forgotten so long after it was sent*/
+    SharedBottleneckConfig sbdConfig;/** delay statistics for the shared bottleneck detection*/
+    LossDifferentiationConfig lossDiffConfig;/** keep random losses from the congestion controller*/
+    bool prrEnabled{ true };/** proportional rate reduction while the congestion controller is in recovery*/
 };
 
 /// SessionStreamController is the single session delegate inside transport module.
@@ -70,7 +248,7 @@ public:
     {
         SPDLOG_TRACE("");
 
-        clock_ = DefaultClock::GetClock();
+        clock_ = Clock::GetClock();
         lastCheckedTime = clock_->Now().ToDebuggingValue();
     }
 
@@ -81,7 +259,8 @@ public:
     }
 
     void StartSessionStreamCtl(const basefw::ID& sessionId, CongestionCtlAlgo* congAlgo,
-            std::weak_ptr<SessionStreamCtlHandler> ssStreamHandler)
+            std::weak_ptr<SessionStreamCtlHandler> ssStreamHandler,
+            const SessionStreamCtlConfig& ssStreamConfig = SessionStreamCtlConfig())
     {
         if (isRunning)
         {
@@ -97,13 +276,33 @@ public:
         // send control
         m_sendCtl.reset(new PacketSender());
 //        m_sendCtl.reset(new PacketSender( congAlgo));
+        if (ssStreamConfig.pacingEnabled)
+        {
+            m_sendCtl->EnablePacing(ssStreamConfig.pacingBurstQuantum, ssStreamConfig.pacingGain);
+        }
 
         //loss detection
-        m_lossDetect.reset(new DefaultLossDetectionAlgo());
+        switch (ssStreamConfig.lossDetectType)
+        {
+            case LossDetectionType::ackbased:
+                m_lossDetect.reset(new AckBasedLossDetectionAlgo());
+                break;
+            default:
+                m_lossDetect.reset(new DefaultLossDetectionAlgo());
+                break;
+        }
 
         // set initial smothed rtt
         m_rttstats.set_initial_rtt(Duration::FromMilliseconds(200));
 
+        m_recentLostCnt = ssStreamConfig.spuriousLossUndo ? ssStreamConfig.recentLostCnt : 0;
+        m_recentLostAge = ssStreamConfig.recentLostAge;
+
+        m_sbdEnabled = ssStreamConfig.sbdConfig.enabled;
+        m_delayStats = SbdDelayStats(ssStreamConfig.sbdConfig);
+        m_lossDiff = LossDifferentiator(ssStreamConfig.lossDiffConfig);
+        m_prrEnabled = ssStreamConfig.prrEnabled;
+
     }
 
     void StopSessionStreamCtl()
@@ -140,7 +339,7 @@ public:
 
 //        return m_sendCtl->CanSend(m_congestionCtl->GetCWND(), GetInFlightPktNum());
         ////////////////
-        auto cwnd = m_congestionCtl->GetCWND();
+        auto cwnd = SendWindow();
 
         SPDLOG_DEBUG("sid: {}, cwnd: {}", m_sessionId.ToStr(), cwnd);
         return m_sendCtl->CanSend(cwnd, GetInFlightPktNum());
@@ -154,9 +353,26 @@ public:
         {
             return false;
         }
-        return m_sendCtl->MaySendPktCnt(m_congestionCtl->GetCWND(), GetInFlightPktNum());
+        UpdatePacer();
+        return m_sendCtl->MaySendPktCnt(SendWindow(), GetInFlightPktNum());
     };
 
+    bool IsPacing()
+    {
+        return isRunning && m_sendCtl->IsPacing();
+    }
+
+    /// @return how long until this session may send the next request, Infinite if it waits for the window
+    Duration TimeUntilNextSend()
+    {
+        if (!isRunning || SendWindow() <= GetInFlightPktNum())
+        {
+            return Duration::Infinite();
+        }
+        UpdatePacer();
+        return m_sendCtl->TimeUntilSend();
+    }
+
     /// send ONE datarequest Pkt, requestting for the data pieces whose id are in spns
     bool DoRequestdata(const basefw::ID& peerid, const std::vector<int32_t>& spns)
     {
@@ -179,7 +395,13 @@ public:
         auto handler = m_ssStreamHandler.lock();
         if (handler)
         {
-            return handler->DoSendDataRequest(peerid, spns);
+            bool rt = handler->DoSendDataRequest(peerid, spns);
+            if (rt)
+            {
+                m_sendCtl->OnPktsSent(spns.size());
+                m_prr.OnPktsSent(spns.size());
+            }
+            return rt;
         }
         else
         {
@@ -205,17 +427,21 @@ public:
             DataPacket p;
             p.seq = seqs[seqidx];
             p.pieceId = datano;
+            auto sentState = m_rateSampler.OnPacketSent(sendtic, m_inflightpktmap.InFlightPktNum());
             // add to downloading queue
-            m_inflightpktmap.AddSentPacket(p, sendtic);
+            m_inflightpktmap.AddSentPacket(p, sendtic, sentState);
 
             // inform cc algo that a packet is sent
             InflightPacket sentpkt;
             sentpkt.seq = seqs[seqidx];
             sentpkt.pieceId = datano;
             sentpkt.sendtic = sendtic;
+            sentpkt.sentState = sentState;
             m_congestionCtl->OnDataSent(sentpkt);
             seqidx++;
         }
+        // the sdk has no one-shot timer, so the loss timer is also serviced when we get a chance
+        CheckLossTimer(sendtic);
 
     }
 
@@ -236,6 +462,11 @@ public:
             // we don't have ack_delay in this simple implementation.
             auto pkt_rtt = recvtic - inflightPkt.sendtic;
             m_rttstats.UpdateRtt(pkt_rtt, Duration::Zero(), Clock::GetClock()->Now());
+            if (m_sbdEnabled)
+            {
+                m_delayStats.OnDelaySample(pkt_rtt, recvtic);
+            }
+            m_lossDiff.OnRttSample(pkt_rtt, recvtic);
 //            auto newsrtt = m_rttstats.smoothed_rtt();
 
 //            auto oldcwnd = m_congestionCtl->GetCWND();
@@ -246,20 +477,72 @@ public:
             ackEvent.ackPacket.pieceId = datapiece;
             ackEvent.sendtic = inflightPkt.sendtic;
             ackEvent.recvstic = recvtic;
-            LossEvent lossEvent; // if we detect loss when ACK event, we may do loss check here.
-            m_congestionCtl->OnDataAckOrLoss(ackEvent, lossEvent, m_rttstats);
-
-//            auto newcwnd = m_congestionCtl->GetCWND();
+            ackEvent.rateSample = m_rateSampler.OnPacketAcked(inflightPkt, recvtic, m_rttstats.min_rtt());
+            ackEvent.delivered = m_rateSampler.GetDeliveryState().delivered;
+            ackEvent.sentState = inflightPkt.sentState;
             // mark as received
             m_inflightpktmap.OnPacktReceived(inflightPkt, recvtic);
+
+            LossEvent lossEvent;
+            if (m_lossDetect->DetectOnAck())
+            {
+                m_lossDetect->DetectLoss(m_inflightpktmap, recvtic, ackEvent, m_inflightpktmap.MaxSeqAckedPkt().seq,
+                        lossEvent, m_rttstats);
+                for (auto&& pkt: lossEvent.lossPackets)
+                {
+                    m_inflightpktmap.RemoveFromInFlight(pkt);
+                }
+            }
+            ReportToCongestionCtl(ackEvent, lossEvent);
+
+//            auto newcwnd = m_congestionCtl->GetCWND();
+            if (lossEvent.valid)
+            {
+                RememberLost(lossEvent);
+                CountLoss(lossEvent);
+                InformLossUp(lossEvent);
+            }
         }
-        else
+        else if (!OnLateArrival(seq, datapiece, recvtic))
         {
             SPDLOG_WARN(" Recv an pkt with unknown seq:{}", seq);
         }
 
     }
 
+    /// stop waiting for piece pno, e.g. another session has delivered it. The requests are neither acked nor lost,
+    /// they just leave the window.
+    /// @return number of requests cancelled
+    uint32_t CancelInFlightPiece(DataNumber pno)
+    {
+        if (!isRunning)
+        {
+            return 0;
+        }
+        std::vector<InflightPacket> cancelled;
+        m_inflightpktmap.ForEachFromOldest([&cancelled, pno](const InflightEntry& entry) {
+            if (entry.pieceId == pno)
+            {
+                cancelled.emplace_back(entry.ToInflightPacket());
+            }
+            return true;
+        });
+        for (auto&& pkt: cancelled)
+        {
+            m_inflightpktmap.RemoveFromInFlight(pkt);
+            m_congestionCtl->OnDataCancelled(pkt);
+        }
+        SPDLOG_DEBUG("session:{}, piece:{}, cancelled:{}", m_sessionId.ToLogStr(), pno, cancelled.size());
+        return cancelled.size();
+    }
+
+    /// visit the requests in flight from the oldest one, stop as soon as visitor returns false
+    template<class Visitor>
+    void ForEachInFlightPacket(Visitor visitor) const
+    {
+        m_inflightpktmap.ForEachFromOldest(visitor);
+    }
+
     void OnLossDetectionAlarm()
     {
         DoAlarmTimeoutDetection();
@@ -310,20 +593,38 @@ public:
         }
         ///check timeout
         Timepoint now_t = Clock::GetClock()->Now();
+        if (now_t < m_lossDetect->GetLossTimer())
+        {
+            SPDLOG_TRACE("loss timer not expired");
+            return;
+        }
         AckEvent ack;
         LossEvent loss;
-        m_lossDetect->DetectLoss(m_inflightpktmap, now_t, ack, -1, loss, m_rttstats);
+        m_lossDetect->DetectLoss(m_inflightpktmap, now_t, ack, m_inflightpktmap.MaxSeqAckedPkt().seq, loss,
+                m_rttstats);
         if (loss.valid)
         {
             for (auto&& pkt: loss.lossPackets)
             {
                 m_inflightpktmap.RemoveFromInFlight(pkt);
             }
-            m_congestionCtl->OnDataAckOrLoss(ack, loss, m_rttstats);
+            ReportToCongestionCtl(ack, loss);
+            RememberLost(loss);
+            CountLoss(loss);
             InformLossUp(loss);
         }
     }
 
+    /// run loss detection if the loss timer of the detection algo has expired
+    void CheckLossTimer(Timepoint now_t)
+    {
+        Timepoint lossTimer = m_lossDetect->GetLossTimer();
+        if (lossTimer.IsInitialized() && lossTimer <= now_t)
+        {
+            DoAlarmTimeoutDetection();
+        }
+    }
+
     Duration GetRtt()
     {
         Duration rtt{ Duration::Zero() };
@@ -335,6 +636,50 @@ public:
         return rtt;
     }
 
+    /// @return mean deviation of the rtt samples
+    Duration GetRttVar()
+    {
+        Duration rttvar{ Duration::Zero() };
+        if (isRunning)
+        {
+            rttvar = m_rttstats.mean_deviation();
+        }
+        SPDLOG_TRACE("rttvar = {}", rttvar.ToDebuggingValue());
+        return rttvar;
+    }
+
+    uint32_t GetCWND()
+    {
+        uint32_t cwnd{ 0 };
+        if (isRunning)
+        {
+            cwnd = m_congestionCtl->GetCWND();
+        }
+        SPDLOG_TRACE("cwnd = {}", cwnd);
+        return cwnd;
+    }
+
+    /// @return windowed max delivery rate of this session in bytes per second, 0 if not measured yet
+    uint64_t GetMaxBandwidth()
+    {
+        uint64_t maxbw{ 0 };
+        if (isRunning)
+        {
+            maxbw = m_rateSampler.GetMaxBandwidth();
+        }
+        SPDLOG_TRACE("maxbw = {}", maxbw);
+        return maxbw;
+    }
+
+    /// the scheduler had nothing to request while this session still had free window
+    void OnAppLimited()
+    {
+        if (isRunning)
+        {
+            m_rateSampler.OnAppLimited(GetInFlightPktNum());
+        }
+    }
+
     uint32_t GetInFlightPktNum()
     {
         return m_inflightpktmap.InFlightPktNum();
@@ -346,7 +691,148 @@ public:
         return m_sessionId;
     }
 
+    /// @return the delay statistics of this session, for the shared bottleneck detection
+    SbdSummary GetDelaySummary() const
+    {
+        return m_sbdEnabled ? m_delayStats.Summary() : SbdSummary();
+    }
+
+    /// the group of sessions this one shares a bottleneck with, as found by the SharedBottleneckDetector
+    void SetBottleneckGroup(uint32_t group, uint32_t groupSize)
+    {
+        if (!isRunning || (group == m_bottleneckGroup && groupSize == m_bottleneckGroupSize))
+        {
+            return;
+        }
+        SPDLOG_DEBUG("session:{}, bottleneck group {} -> {} of {} sessions", m_sessionId.ToLogStr(),
+                m_bottleneckGroup, group, groupSize);
+        m_bottleneckGroup = group;
+        m_bottleneckGroupSize = groupSize;
+        m_congestionCtl->OnBottleneckGroup(group, groupSize);
+    }
+
+    uint32_t GetBottleneckGroup() const
+    {
+        return m_bottleneckGroup;
+    }
+
 private:
+    /// random losses leave the window as if cancelled, the congestion controller only sees the ack
+    void ReportToCongestionCtl(AckEvent& ackEvent, LossEvent& lossEvent)
+    {
+        ackEvent.inflight = m_inflightpktmap.InFlightPktNum();
+        lossEvent.priorInflight = ackEvent.inflight + lossEvent.lossPackets.size();
+        if (!m_lossDiff.IsRandomLoss(lossEvent, m_rttstats))
+        {
+            m_congestionCtl->OnDataAckOrLoss(ackEvent, lossEvent, m_rttstats);
+        }
+        else
+        {
+            for (auto&& pkt: lossEvent.lossPackets)
+            {
+                m_congestionCtl->OnDataCancelled(pkt);
+            }
+            if (ackEvent.valid)
+            {
+                m_congestionCtl->OnDataAckOrLoss(ackEvent, LossEvent(), m_rttstats);
+            }
+        }
+        UpdateRecovery(ackEvent, lossEvent);
+    }
+
+    /// follow the recovery of the congestion controller, the lost pieces have left the in flight map already
+    void UpdateRecovery(const AckEvent& ackEvent, const LossEvent& lossEvent)
+    {
+        bool inRecovery = m_prrEnabled && m_congestionCtl->InRecovery();
+        if (inRecovery && !m_prr.InRecovery())
+        {
+            m_prr.OnEnterRecovery(GetInFlightPktNum() + lossEvent.lossPackets.size() + (ackEvent.valid ? 1 : 0));
+        }
+        else if (!inRecovery && m_prr.InRecovery())
+        {
+            m_prr.OnExitRecovery();
+        }
+        if (ackEvent.valid)
+        {
+            m_prr.OnPktsAcked(1);
+        }
+    }
+
+    /// the window the requests may fill now, the one of the congestion controller unless in recovery
+    uint32_t SendWindow()
+    {
+        uint32_t cwnd = m_congestionCtl->GetCWND();
+        if (!m_prr.InRecovery())
+        {
+            return cwnd;
+        }
+        return m_prr.SendWindow(GetInFlightPktNum(), cwnd);
+    }
+
+    void CountLoss(const LossEvent& loss)
+    {
+        if (m_sbdEnabled)
+        {
+            m_delayStats.OnLoss(loss.lossPackets.size(), loss.losttic);
+        }
+    }
+
+    /// keep the lost requests for a while, so that a late answer can be matched
+    void RememberLost(const LossEvent& loss)
+    {
+        if (m_recentLostCnt == 0)
+        {
+            return;
+        }
+        m_recentLost.insert(m_recentLost.end(), loss.lossPackets.begin(), loss.lossPackets.end());
+        while (m_recentLost.size() > m_recentLostCnt)
+        {
+            m_recentLost.pop_front();
+        }
+    }
+
+    /// an answer to a request which isn't in flight, check if it was declared lost too early
+    /// @return true if it matches a recently lost request
+    bool OnLateArrival(SeqNumber seq, DataNumber datapiece, Timepoint recvtic)
+    {
+        while (!m_recentLost.empty() && m_recentLost.front().sendtic + m_recentLostAge < recvtic)
+        {
+            m_recentLost.pop_front();
+        }
+        auto&& lost_itor = std::find_if(m_recentLost.begin(), m_recentLost.end(),
+                [seq, datapiece](const InflightPacket& pkt) {
+                    return pkt.seq == seq && pkt.pieceId == datapiece;
+                });
+        if (lost_itor == m_recentLost.end())
+        {
+            return false;
+        }
+        InflightPacket lostpkt = *lost_itor;
+        m_recentLost.erase(lost_itor);
+        // the seq tells which request was answered, so the sample is valid, and it keeps the next timeout from
+        // firing as early
+        m_rttstats.UpdateRtt(recvtic - lostpkt.sendtic, Duration::Zero(), Clock::GetClock()->Now());
+        m_congestionCtl->OnSpuriousLoss(lostpkt);
+        UpdateRecovery(AckEvent(), LossEvent());
+        SPDLOG_DEBUG("session:{}, piece:{} seq:{} declared lost, arrived {} after it was sent", m_sessionId.ToLogStr(),
+                datapiece, seq, (recvtic - lostpkt.sendtic).ToDebuggingValue());
+        auto handler = m_ssStreamHandler.lock();
+        if (handler)
+        {
+            handler->OnPieceSpuriousLoss(m_sessionId, datapiece);
+        }
+        return true;
+    }
+
+    void UpdatePacer()
+    {
+        if (m_sendCtl->IsPacing())
+        {
+            m_sendCtl->UpdatePacing(m_congestionCtl->GetCWND(), m_rttstats.SmoothedOrInitialRtt(),
+                    Clock::GetClock()->Now(), m_congestionCtl->GetPacingRate());
+        }
+    }
+
     bool isRunning{ false };
 
     basefw::ID m_sessionId;/** The remote peer id defines the session id*/
@@ -359,6 +845,17 @@ private:
 
     std::unique_ptr<PacketSender> m_sendCtl;
     RttStats m_rttstats;
+    DeliveryRateSampler m_rateSampler;
+    std::deque<InflightPacket> m_recentLost;/** lost requests, oldest first*/
+    uint32_t m_recentLostCnt{ 0 };
+    Duration m_recentLostAge{ Duration::Zero() };
+    bool m_sbdEnabled{ false };
+    SbdDelayStats m_delayStats;
+    LossDifferentiator m_lossDiff;
+    bool m_prrEnabled{ false };
+    ProportionalRateReduction m_prr;
+    uint32_t m_bottleneckGroup{ SharedBottleneckDetector::kUnknownGroup };
+    uint32_t m_bottleneckGroupSize{ 1 };
 
     const QuicClock *clock_;
 
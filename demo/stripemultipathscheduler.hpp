@@ -0,0 +1,168 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <queue>
+#include "rrmultipathscheduler.hpp"
+
+/// config for StripeMultiPathScheduler
+struct StripeSchedulerConfig {
+    uint32_t stripeRounds{ 2 };/** a stripe tops up each session's backlog to this many rounds of its cwnd*/
+};
+
+/// Bandwidth proportional striping multipath scheduler.
+/// Instead of handing out the lowest pieces one window at a time, the upcoming pieces are split into contiguous
+/// blocks, one for each session, sized to the session's rate so that every session finishes its block at about the
+/// same time. The block expected to start arriving first is the lowest one, so the contiguous part advances smoothly.
+/// Blocks are kept in the session queues and sent as the window opens, a new stripe is planned when a session has
+/// run out of its block.
+/// The blocks of the slower sessions arrive behind the ones of the faster sessions by design, so the opportunistic
+/// retransmission, which would take them for a blocked head, isn't enabled.
+class StripeMultiPathScheduler : public RRMultiPathScheduler {
+public:
+    MultiPathSchedulerType SchedulerType() override {
+        return MultiPathSchedulerType::MULTI_PATH_SCHEDULE_STRIPE;
+    }
+
+    explicit StripeMultiPathScheduler(const fw::ID &taskid,
+                                      std::map<fw::ID, fw::shared_ptr<SessionStreamController>> &dlsessionmap,
+                                      PieceWindow &downloadQueue, PieceWindow &lostPiecesQueue,
+                                      PieceTable &pieceTable,
+                                      const StripeSchedulerConfig &config,
+                                      const EndgameConfig &endgameConfig = EndgameConfig(),
+                                      const SessionHealthConfig &healthConfig = SessionHealthConfig())
+            : RRMultiPathScheduler(taskid, dlsessionmap, downloadQueue, lostPiecesQueue, pieceTable,
+                                   endgameConfig.maxDuplicateBytes),
+              m_config(config) {
+        SPDLOG_DEBUG("taskid :{}, stripeRounds: {}", taskid.ToLogStr(), m_config.stripeRounds);
+        EnableEndgame(endgameConfig);
+        EnableSessionHealth(healthConfig);
+    }
+
+    ~StripeMultiPathScheduler() override {
+        SPDLOG_TRACE("");
+    }
+
+    uint32_t DoSinglePathSchedule(const fw::ID &sessionid) override {
+        SPDLOG_DEBUG("session:{}", sessionid.ToLogStr());
+
+        auto &&session_itor = m_dlsessionmap.find(sessionid);
+        if (session_itor == m_dlsessionmap.end() || !session_itor->second) {
+            SPDLOG_WARN("Unknown session: {}", sessionid.ToLogStr());
+            return -1;
+        }
+
+        MergeLostPieces();
+
+        if (session_itor->second->CanRequestPktCnt() == 0) {
+            SPDLOG_TRACE("Free Wnd equals to 0");
+            return -1;
+        }
+
+        if (SchedulableCnt(sessionid, session_itor->second) > 0) {
+            // the session has run out of its block
+            PlanStripe();
+        }
+
+        DoSendSessionSubTask(sessionid);
+        return 0;
+    }
+
+protected:
+    void AssignSessionTasks(std::map<basefw::ID, uint32_t> &toSendinEachSession) override {
+        for (auto &&id_sendcnt: toSendinEachSession) {
+            if (id_sendcnt.second > 0) {
+                PlanStripe();
+                return;
+            }
+        }
+    }
+
+private:
+    struct StripeSlot {
+        fw::ID sessId;
+        double piecesPerUs{ 0 };/** delivery rate of the session*/
+        int64_t startUs{ 0 };/** expected arrival of the first piece of a block handed to the session now*/
+        uint32_t blockCnt{ 0 };
+    };
+
+    /// split the lowest pieces of the download queue into one contiguous block for each session
+    void PlanStripe() {
+        // 1. sessions in min rtt order, with their rate and backlog
+        std::multimap<Duration, fw::shared_ptr<SessionStreamController>> sortmmap;
+        SortSession(sortmmap);
+        std::vector<StripeSlot> slots;
+        uint32_t stripeCnt = 0;
+        for (auto &&rtt_session: sortmmap) {
+            auto &session = rtt_session.second;
+            fw::ID sessId = session->GetSessionID();
+            Duration rtt = ExpectedRtt(session);
+            uint32_t cwnd = std::max(session->GetCWND(), 1U);
+            auto &&queue_itor = m_session_needdownloadpieceQ.find(sessId);
+            if (queue_itor == m_session_needdownloadpieceQ.end() || IsQuarantined(sessId)) {
+                continue;
+            }
+            uint32_t backlog = session->GetInFlightPktNum() + queue_itor->second.size();
+
+            StripeSlot slot;
+            slot.sessId = sessId;
+            uint64_t maxbw = session->GetMaxBandwidth();
+            slot.piecesPerUs = maxbw > 0 ? maxbw / 1000000.0 / kDataPieceSize
+                                         : static_cast<double>(cwnd) / rtt.ToMicroseconds();
+            slot.startUs = rtt.ToMicroseconds() + static_cast<int64_t>(backlog / slot.piecesPerUs);
+            slots.push_back(slot);
+
+            uint32_t target = m_config.stripeRounds * cwnd;
+            stripeCnt += target > backlog ? target - backlog : 0;
+        }
+        if (slots.empty() || stripeCnt == 0) {
+            return;
+        }
+
+        if (m_downloadQueue.size() < stripeCnt) {
+            auto handler = m_phandler.lock();
+            if (handler) {
+                handler->OnRequestDownloadPieces(stripeCnt - m_downloadQueue.size());
+            } else {
+                SPDLOG_ERROR("handler = null");
+            }
+        }
+        stripeCnt = std::min<uint32_t>(stripeCnt, m_downloadQueue.size());
+
+        // 2. each piece goes to the session which would finish it earliest, which levels the finish times
+        auto finishUs = [&slots](size_t idx) {
+            return slots[idx].startUs + (slots[idx].blockCnt + 1) / slots[idx].piecesPerUs;
+        };
+        auto later = [&finishUs](size_t a, size_t b) {
+            return finishUs(a) > finishUs(b) || (finishUs(a) == finishUs(b) && a > b);
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> earliest(later);
+        for (size_t idx = 0; idx < slots.size(); ++idx) {
+            earliest.push(idx);
+        }
+        for (uint32_t i = 0; i < stripeCnt; ++i) {
+            size_t idx = earliest.top();
+            earliest.pop();
+            ++slots[idx].blockCnt;
+            earliest.push(idx);
+        }
+
+        // 3. the block which starts arriving first is the lowest one
+        std::stable_sort(slots.begin(), slots.end(), [](const StripeSlot &a, const StripeSlot &b) {
+            return a.startUs < b.startUs;
+        });
+        for (auto &&slot: slots) {
+            if (slot.blockCnt == 0) {
+                continue;
+            }
+            auto &sessionQueue = m_session_needdownloadpieceQ[slot.sessId];
+            for (uint32_t i = 0; i < slot.blockCnt && !m_downloadQueue.empty(); ++i) {
+                sessionQueue.Insert(m_downloadQueue.PopLowest());
+            }
+            SPDLOG_TRACE("session {} gets a block of {} pieces", slot.sessId.ToLogStr(), slot.blockCnt);
+        }
+    }
+
+    StripeSchedulerConfig m_config;
+};
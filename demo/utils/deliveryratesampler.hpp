@@ -0,0 +1,125 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+#include "utils/windowedfilter.hpp"
+#include "packettype.h"
+
+/// delivery rate sample produced by one ack
+struct RateSample
+{
+    bool valid{ false };
+    uint64_t deliveryRate{ 0 };/** bytes per second*/
+    uint64_t deliveredBytes{ 0 };/** bytes delivered in the sampling interval*/
+    Duration interval{ Duration::Zero() };
+    bool isAppLimited{ false };/** the rate is limited by the application, not the path*/
+    bool roundStart{ false };/** this ack ends a round trip, set even if the sample isn't valid*/
+    uint64_t roundCount{ 0 };/** round trips so far, this one included*/
+    uint64_t maxDeliveryRate{ 0 };/** max over the last bwWindowRounds round trips, this sample included*/
+};
+
+/// DeliveryRateSampler measures the goodput of one session, the same way as tcp_rate.c in Linux.
+/// Every packet sent is stamped with the delivery state of the session. When it's acked, the rate sample is the bytes
+/// delivered since then over max(send interval, ack interval). Samples taken while the session runs out of pieces
+/// to request are flagged app-limited, and only raise the max bandwidth estimate if they exceed it.
+/// A round trip ends when a packet sent after the previous round end is acked, the congestion controllers count
+/// their rounds from the roundStart of the samples.
+class DeliveryRateSampler
+{
+public:
+    explicit DeliveryRateSampler(uint32_t bwWindowRounds = 10) : m_maxBwFilter(bwWindowRounds, 0)
+    {
+    }
+
+    /// @param inflightPkts packets in flight before this one
+    /// @return the delivery state to be stamped on the packet
+    DeliveryState OnPacketSent(Timepoint sendtic, size_t inflightPkts)
+    {
+        if (inflightPkts == 0)
+        {
+            // start a new sampling interval, the time spent idle is not counted
+            m_state.firstSentTic = sendtic;
+            m_state.deliveredTic = sendtic;
+        }
+        m_state.isAppLimited = m_appLimitedUntil > 0;
+        return m_state;
+    }
+
+    RateSample OnPacketAcked(const InflightPacket& ackedpkt, Timepoint recvtic, Duration minRtt)
+    {
+        m_state.delivered += kDataPieceSize;
+        m_state.deliveredTic = recvtic;
+        if (ackedpkt.sendtic > m_state.firstSentTic)
+        {
+            m_state.firstSentTic = ackedpkt.sendtic;
+        }
+        if (m_appLimitedUntil > 0 && m_state.delivered > m_appLimitedUntil)
+        {
+            m_appLimitedUntil = 0;
+        }
+        RateSample rs;
+        if (ackedpkt.sentState.delivered >= m_nextRoundDelivered)
+        {
+            m_nextRoundDelivered = m_state.delivered;
+            ++m_roundCount;
+            rs.roundStart = true;
+        }
+        rs.roundCount = m_roundCount;
+        rs.maxDeliveryRate = m_maxBwFilter.GetBest();
+
+        const DeliveryState& prior = ackedpkt.sentState;
+        if (!prior.firstSentTic.IsInitialized())
+        {
+            return rs;
+        }
+        Duration sendElapsed = ackedpkt.sendtic - prior.firstSentTic;
+        Duration ackElapsed = recvtic - prior.deliveredTic;
+        rs.interval = std::max(sendElapsed, ackElapsed);
+        rs.deliveredBytes = m_state.delivered - prior.delivered;
+        rs.isAppLimited = prior.isAppLimited;
+        // an interval shorter than min rtt comes from ack compression and overestimates the rate
+        if (rs.interval.ToMicroseconds() <= 0 || (!minRtt.IsZero() && rs.interval < minRtt))
+        {
+            SPDLOG_TRACE("invalid interval {}", rs.interval.ToDebuggingValue());
+            return rs;
+        }
+        rs.valid = true;
+        rs.deliveryRate = rs.deliveredBytes * 1000000 / rs.interval.ToMicroseconds();
+        if (!rs.isAppLimited || rs.deliveryRate >= m_maxBwFilter.GetBest())
+        {
+            m_maxBwFilter.Update(rs.deliveryRate, m_roundCount);
+            rs.maxDeliveryRate = m_maxBwFilter.GetBest();
+        }
+        SPDLOG_TRACE("rate: {} bytes/s, interval: {}, app limited: {}", rs.deliveryRate,
+                rs.interval.ToDebuggingValue(), rs.isAppLimited);
+        return rs;
+    }
+
+    /// the session has free window but nothing to request, the packets in flight now end the app-limited period
+    void OnAppLimited(size_t inflightPkts)
+    {
+        m_appLimitedUntil = std::max<uint64_t>(m_state.delivered + inflightPkts * kDataPieceSize, 1);
+    }
+
+    const DeliveryState& GetDeliveryState() const
+    {
+        return m_state;
+    }
+
+    /// @return max delivery rate over the last bwWindowRounds round trips, bytes per second
+    uint64_t GetMaxBandwidth() const
+    {
+        return m_maxBwFilter.GetBest();
+    }
+
+private:
+    DeliveryState m_state;
+    uint64_t m_appLimitedUntil{ 0 };/** delivered count which ends the app-limited period, 0 if not app-limited*/
+    uint64_t m_roundCount{ 0 };
+    uint64_t m_nextRoundDelivered{ 0 };
+    WindowedFilter<uint64_t, MaxFilter<uint64_t>> m_maxBwFilter;/** windowed by round count*/
+};
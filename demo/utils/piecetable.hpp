@@ -0,0 +1,218 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "basefw/base/hash.h"
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+#include "packettype.h"
+
+/// where a piece of the task is
+enum class PieceState : uint8_t
+{
+    absent = 0,/** not handed over by the task*/
+    pending = 1,/** waiting in the download, lost or a session queue*/
+    inflight = 2,/** requested on at least one session*/
+    received = 3
+};
+
+/// side record of a piece which has been requested, dropped once the piece is received
+struct PieceRecord
+{
+    uint32_t attempts{ 0 };/** requests sent, copies included*/
+    Timepoint firstRequest{ Timepoint::Zero() };
+    Timepoint lastRequest{ Timepoint::Zero() };
+    std::vector<fw::ID> sessions;/** sessions tried, the last one requested it last*/
+};
+
+/// PieceTable holds the state of every piece of the task, 2 bits per piece.
+/// The bits are kept in pages of 64K pieces allocated on first use, and a page is freed again once all its pieces
+/// have been received, so the memory follows the part of the file in progress rather than the file size. The queues
+/// only order the pieces waiting to be requested, the table tells where any piece is in O(1).
+class PieceTable
+{
+public:
+    PieceState State(DataNumber pno) const
+    {
+        if (pno < 0)
+        {
+            return PieceState::absent;
+        }
+        size_t page = static_cast<size_t>(pno) >> kPageShift;
+        if (page >= m_pages.size())
+        {
+            return PieceState::absent;
+        }
+        if (!m_pages[page])
+        {
+            return m_fullPages[page] ? PieceState::received : PieceState::absent;
+        }
+        return static_cast<PieceState>((m_pages[page]->words[WordIndex(pno)] >> BitShift(pno)) & kStateMask);
+    }
+
+    /// the task has handed the piece over
+    /// @return false if the piece is already known
+    bool OnAdded(DataNumber pno)
+    {
+        if (State(pno) != PieceState::absent)
+        {
+            return false;
+        }
+        return SetState(pno, PieceState::pending);
+    }
+
+    /// a copy of the piece has been requested on the session
+    void OnRequested(DataNumber pno, const fw::ID& sessionid, Timepoint now)
+    {
+        PieceState state = State(pno);
+        if (state == PieceState::received || !SetState(pno, PieceState::inflight))
+        {
+            return;
+        }
+        auto& record = m_records[pno];
+        if (record.attempts++ == 0)
+        {
+            record.firstRequest = now;
+        }
+        record.lastRequest = now;
+        record.sessions.erase(std::remove(record.sessions.begin(), record.sessions.end(), sessionid),
+                record.sessions.end());
+        record.sessions.push_back(sessionid);
+    }
+
+    /// no copy of the piece is in flight anymore, it waits to be requested again
+    void OnRequeued(DataNumber pno)
+    {
+        if (State(pno) == PieceState::inflight)
+        {
+            SetState(pno, PieceState::pending);
+        }
+    }
+
+    /// @return false if the piece had been received already
+    bool OnReceived(DataNumber pno)
+    {
+        if (State(pno) == PieceState::received)
+        {
+            return false;
+        }
+        auto&& record_itor = m_records.find(pno);
+        if (record_itor != m_records.end())
+        {
+            if (record_itor->second.attempts > 1)
+            {
+                SPDLOG_DEBUG("piece {} received after {} attempts on {} sessions", pno, record_itor->second.attempts,
+                        record_itor->second.sessions.size());
+            }
+            m_records.erase(record_itor);
+        }
+        return SetState(pno, PieceState::received);
+    }
+
+    /// @return the record of a piece which has been requested but not received yet, nullptr otherwise
+    const PieceRecord* Record(DataNumber pno) const
+    {
+        auto&& record_itor = m_records.find(pno);
+        return record_itor != m_records.end() ? &record_itor->second : nullptr;
+    }
+
+    /// @return the number of pieces in a state other than absent
+    size_t Count(PieceState state) const
+    {
+        return m_counts[static_cast<size_t>(state)];
+    }
+
+    /// @return the number of pages holding state bits, the fully received pages are freed
+    size_t AllocatedPages() const
+    {
+        return static_cast<size_t>(std::count_if(m_pages.begin(), m_pages.end(),
+                [](const std::unique_ptr<Page>& page) { return page != nullptr; }));
+    }
+
+    void clear()
+    {
+        m_pages.clear();
+        m_fullPages.clear();
+        m_records.clear();
+        std::fill(std::begin(m_counts), std::end(m_counts), 0);
+    }
+
+private:
+    static constexpr size_t kPageShift = 16;
+    static constexpr size_t kPagePieces = size_t(1) << kPageShift;
+    static constexpr size_t kPiecesPerWord = 32;/** 2 bits each*/
+    static constexpr uint64_t kStateMask = 3;
+
+    struct Page
+    {
+        std::vector<uint64_t> words = std::vector<uint64_t>(kPagePieces / kPiecesPerWord, 0);
+        size_t receivedCnt{ 0 };
+    };
+
+    static size_t WordIndex(DataNumber pno)
+    {
+        return (static_cast<size_t>(pno) & (kPagePieces - 1)) / kPiecesPerWord;
+    }
+
+    static size_t BitShift(DataNumber pno)
+    {
+        return (static_cast<size_t>(pno) % kPiecesPerWord) * 2;
+    }
+
+    /// @return false if the piece is in a page which has been fully received
+    bool SetState(DataNumber pno, PieceState state)
+    {
+        if (pno < 0)
+        {
+            SPDLOG_WARN("invalid piece number {}", pno);
+            return false;
+        }
+        size_t page = static_cast<size_t>(pno) >> kPageShift;
+        if (page >= m_pages.size())
+        {
+            m_pages.resize(page + 1);
+            m_fullPages.resize(page + 1, false);
+        }
+        if (!m_pages[page])
+        {
+            if (m_fullPages[page])
+            {
+                return false;
+            }
+            m_pages[page].reset(new Page());
+        }
+        Page& bits = *m_pages[page];
+        uint64_t& word = bits.words[WordIndex(pno)];
+        auto old = static_cast<PieceState>((word >> BitShift(pno)) & kStateMask);
+        word = (word & ~(kStateMask << BitShift(pno))) | (static_cast<uint64_t>(state) << BitShift(pno));
+        if (old != PieceState::absent)
+        {
+            --m_counts[static_cast<size_t>(old)];
+        }
+        if (state != PieceState::absent)
+        {
+            ++m_counts[static_cast<size_t>(state)];
+        }
+        if (old != PieceState::received && state == PieceState::received && ++bits.receivedCnt == kPagePieces)
+        {
+            m_pages[page].reset();
+            m_fullPages[page] = true;
+        }
+        else if (old == PieceState::received && state != PieceState::received)
+        {
+            --bits.receivedCnt;
+        }
+        return true;
+    }
+
+    std::vector<std::unique_ptr<Page>> m_pages;/** indexed by pno >> kPageShift, null until used*/
+    std::vector<bool> m_fullPages;/** pages freed since all their pieces have been received*/
+    std::unordered_map<DataNumber, PieceRecord> m_records;
+    size_t m_counts[4]{ 0, 0, 0, 0 };/** pieces in each state, absent ones aren't counted*/
+};
@@ -0,0 +1,349 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+#include "packettype.h"
+
+/// PieceWindow is a set of piece numbers kept as a sliding bitmap.
+/// Piece numbers waiting to be downloaded are dense integers near the play position, so the bits are stored in a
+/// ring of 64-bit words which starts from the lowest word in use. Insert, test and erase are O(1), pop lowest is
+/// amortized O(1), and no memory is allocated unless the window grows.
+class PieceWindow
+{
+public:
+    /// iterate the pieces in ascending order
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = DataNumber;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const DataNumber*;
+        using reference = const DataNumber&;
+
+        const_iterator() = default;
+
+        const_iterator(const PieceWindow* window, DataNumber pno) : m_window(window), m_pno(pno)
+        {
+        }
+
+        reference operator*() const
+        {
+            return m_pno;
+        }
+
+        const_iterator& operator++()
+        {
+            m_pno = m_pno == MAX_DATANUMBER ? MAX_DATANUMBER : m_window->NextFrom(m_pno + 1);
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return m_pno == other.m_pno;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return m_pno != other.m_pno;
+        }
+
+    private:
+        const PieceWindow* m_window{ nullptr };
+        DataNumber m_pno{ MAX_DATANUMBER };
+    };
+
+    /// @return true if pno is newly inserted
+    bool Insert(DataNumber pno)
+    {
+        if (pno < 0)
+        {
+            SPDLOG_WARN("invalid piece number {}", pno);
+            return false;
+        }
+        int64_t word = pno >> kWordShift;
+        ExtendTo(word, word);
+        uint64_t& bits = WordAt(word);
+        uint64_t mask = uint64_t(1) << (pno & kWordMask);
+        if (bits & mask)
+        {
+            return false;
+        }
+        bits |= mask;
+        ++m_count;
+        return true;
+    }
+
+    /// insert all the pieces in [first, last)
+    void InsertRange(DataNumber first, DataNumber last)
+    {
+        if (first < 0 || first >= last)
+        {
+            return;
+        }
+        int64_t firstWord = first >> kWordShift;
+        int64_t lastWord = (last - 1) >> kWordShift;
+        ExtendTo(firstWord, lastWord);
+        for (int64_t word = firstWord; word <= lastWord; ++word)
+        {
+            uint64_t mask = ~uint64_t(0);
+            if (word == firstWord)
+            {
+                mask &= ~uint64_t(0) << (first & kWordMask);
+            }
+            if (word == lastWord)
+            {
+                mask &= ~uint64_t(0) >> (kWordMask - ((last - 1) & kWordMask));
+            }
+            uint64_t& bits = WordAt(word);
+            m_count += __builtin_popcountll(mask & ~bits);
+            bits |= mask;
+        }
+    }
+
+    template<class InputIt>
+    void Insert(InputIt first, InputIt last)
+    {
+        for (; first != last; ++first)
+        {
+            Insert(*first);
+        }
+    }
+
+    /// merge all pieces of another window, word by word
+    void Insert(const PieceWindow& other)
+    {
+        if (other.empty())
+        {
+            return;
+        }
+        ExtendTo(other.m_baseWord, other.m_baseWord + other.m_usedWords - 1);
+        for (size_t i = 0; i < other.m_usedWords; ++i)
+        {
+            int64_t word = other.m_baseWord + i;
+            uint64_t add = other.m_words[(other.m_head + i) & (other.m_words.size() - 1)];
+            uint64_t& bits = WordAt(word);
+            m_count += __builtin_popcountll(add & ~bits);
+            bits |= add;
+        }
+    }
+
+    bool Contains(DataNumber pno) const
+    {
+        if (pno < 0 || !InWindow(pno >> kWordShift))
+        {
+            return false;
+        }
+        return (WordAt(pno >> kWordShift) >> (pno & kWordMask)) & 1U;
+    }
+
+    /// @return true if pno was in the window
+    bool Erase(DataNumber pno)
+    {
+        if (pno < 0 || !InWindow(pno >> kWordShift))
+        {
+            return false;
+        }
+        uint64_t& bits = WordAt(pno >> kWordShift);
+        uint64_t mask = uint64_t(1) << (pno & kWordMask);
+        if (!(bits & mask))
+        {
+            return false;
+        }
+        bits &= ~mask;
+        --m_count;
+        Shrink();
+        return true;
+    }
+
+    /// @return the lowest piece number, MAX_DATANUMBER if empty
+    DataNumber Lowest() const
+    {
+        if (m_count == 0)
+        {
+            return MAX_DATANUMBER;
+        }
+        // the first word in use is never zero
+        return static_cast<DataNumber>((m_baseWord << kWordShift) + __builtin_ctzll(m_words[m_head]));
+    }
+
+    /// remove and return the lowest piece number, MAX_DATANUMBER if empty
+    DataNumber PopLowest()
+    {
+        if (m_count == 0)
+        {
+            return MAX_DATANUMBER;
+        }
+        uint64_t& bits = m_words[m_head];
+        DataNumber pno = static_cast<DataNumber>((m_baseWord << kWordShift) + __builtin_ctzll(bits));
+        bits &= bits - 1;
+        --m_count;
+        Shrink();
+        return pno;
+    }
+
+    /// @return the lowest piece number not less than pno, MAX_DATANUMBER if none
+    DataNumber NextFrom(DataNumber pno) const
+    {
+        if (m_count == 0)
+        {
+            return MAX_DATANUMBER;
+        }
+        pno = std::max<DataNumber>(pno, 0);
+        int64_t word = pno >> kWordShift;
+        uint64_t bits = 0;
+        if (word < m_baseWord)
+        {
+            word = m_baseWord;
+            bits = WordAt(word);
+        }
+        else if (InWindow(word))
+        {
+            bits = WordAt(word) & (~uint64_t(0) << (pno & kWordMask));
+        }
+        else
+        {
+            return MAX_DATANUMBER;
+        }
+        while (bits == 0)
+        {
+            if (!InWindow(++word))
+            {
+                return MAX_DATANUMBER;
+            }
+            bits = WordAt(word);
+        }
+        return static_cast<DataNumber>((word << kWordShift) + __builtin_ctzll(bits));
+    }
+
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    bool empty() const
+    {
+        return m_count == 0;
+    }
+
+    /// keep the storage for later use
+    void clear()
+    {
+        for (size_t i = 0; i < m_usedWords; ++i)
+        {
+            m_words[(m_head + i) & (m_words.size() - 1)] = 0;
+        }
+        m_head = 0;
+        m_usedWords = 0;
+        m_count = 0;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, Lowest());
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, MAX_DATANUMBER);
+    }
+
+private:
+    static constexpr int64_t kWordShift = 6;
+    static constexpr int64_t kWordMask = 63;
+    static constexpr size_t kMinWords = 4;
+
+    bool InWindow(int64_t word) const
+    {
+        return m_usedWords > 0 && word >= m_baseWord && word < m_baseWord + static_cast<int64_t>(m_usedWords);
+    }
+
+    uint64_t& WordAt(int64_t word)
+    {
+        return m_words[(m_head + (word - m_baseWord)) & (m_words.size() - 1)];
+    }
+
+    const uint64_t& WordAt(int64_t word) const
+    {
+        return m_words[(m_head + (word - m_baseWord)) & (m_words.size() - 1)];
+    }
+
+    /// make words [firstWord, lastWord] part of the window. Words outside the window are always zero.
+    void ExtendTo(int64_t firstWord, int64_t lastWord)
+    {
+        if (m_usedWords == 0)
+        {
+            Reserve(lastWord - firstWord + 1);
+            m_head = 0;
+            m_baseWord = firstWord;
+            m_usedWords = lastWord - firstWord + 1;
+            return;
+        }
+        int64_t newBase = std::min(firstWord, m_baseWord);
+        int64_t newEnd = std::max(lastWord + 1, m_baseWord + static_cast<int64_t>(m_usedWords));
+        Reserve(newEnd - newBase);
+        m_head = (m_head - (m_baseWord - newBase)) & (m_words.size() - 1);
+        m_baseWord = newBase;
+        m_usedWords = newEnd - newBase;
+    }
+
+    void Reserve(size_t words)
+    {
+        if (words <= m_words.size())
+        {
+            return;
+        }
+        size_t newCap = m_words.empty() ? kMinWords : m_words.size();
+        while (newCap < words)
+        {
+            newCap <<= 1U;
+        }
+        std::vector<uint64_t> newWords(newCap, 0);
+        for (size_t i = 0; i < m_usedWords; ++i)
+        {
+            newWords[i] = m_words[(m_head + i) & (m_words.size() - 1)];
+        }
+        m_words.swap(newWords);
+        m_head = 0;
+    }
+
+    /// drop empty words at both ends of the window
+    void Shrink()
+    {
+        if (m_count == 0)
+        {
+            clear();
+            return;
+        }
+        while (m_words[m_head] == 0)
+        {
+            m_head = (m_head + 1) & (m_words.size() - 1);
+            ++m_baseWord;
+            --m_usedWords;
+        }
+        while (WordAt(m_baseWord + m_usedWords - 1) == 0)
+        {
+            --m_usedWords;
+        }
+    }
+
+    std::vector<uint64_t> m_words;/** ring of bitmap words, capacity is a power of 2*/
+    size_t m_head{ 0 };/** ring index of m_baseWord*/
+    int64_t m_baseWord{ 0 };/** word number of the lowest word in use*/
+    size_t m_usedWords{ 0 };/** number of words in use, starting from m_baseWord*/
+    size_t m_count{ 0 };
+};
@@ -0,0 +1,172 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+#include "packettype.h"
+
+/// ReceiveBitmap tracks the received pieces as the contiguous prefix [0, ContiguousEnd()) plus a bitmap of the pieces
+/// received beyond it.
+/// The bitmap is a ring of 64-bit words starting from the word of the prefix end, the bits below the prefix end are
+/// kept set. Receiving a piece is O(1), and the prefix moves over fully received words at once and finds the first
+/// missing bit in a word with a single ctz, so it's amortized O(1) per piece. A word leaves the ring as soon as the
+/// prefix has passed it.
+class ReceiveBitmap
+{
+public:
+    /// @return false if the piece had been received already
+    bool Insert(DataNumber pno)
+    {
+        if (pno < m_contiguousEnd)
+        {
+            return false;
+        }
+        int64_t word = pno >> kWordShift;
+        Reserve(word - m_baseWord + 1);
+        uint64_t& bits = WordAt(word);
+        uint64_t mask = uint64_t(1) << (pno & kWordMask);
+        if (bits & mask)
+        {
+            return false;
+        }
+        bits |= mask;
+        m_usedWords = std::max<size_t>(m_usedWords, word - m_baseWord + 1);
+        if (pno == m_contiguousEnd)
+        {
+            Advance();
+        }
+        else
+        {
+            ++m_aheadCnt;
+        }
+        return true;
+    }
+
+    bool Contains(DataNumber pno) const
+    {
+        if (pno < 0)
+        {
+            return false;
+        }
+        if (pno < m_contiguousEnd)
+        {
+            return true;
+        }
+        int64_t word = pno >> kWordShift;
+        if (word - m_baseWord >= static_cast<int64_t>(m_usedWords))
+        {
+            return false;
+        }
+        return (WordAt(word) >> (pno & kWordMask)) & 1U;
+    }
+
+    /// pieces in [0, ContiguousEnd()) have been received, ContiguousEnd() is the first missing piece
+    DataNumber ContiguousEnd() const
+    {
+        return m_contiguousEnd;
+    }
+
+    /// @return the lowest received piece beyond the prefix, MAX_DATANUMBER if none.
+    /// The head-of-line gap is [ContiguousEnd(), NextReceived()).
+    DataNumber NextReceived() const
+    {
+        if (m_aheadCnt == 0)
+        {
+            return MAX_DATANUMBER;
+        }
+        // the bits below the prefix end are set, they don't count
+        uint64_t bits = m_words[m_head] & (~uint64_t(0) << (m_contiguousEnd & kWordMask));
+        for (int64_t word = m_baseWord; word - m_baseWord < static_cast<int64_t>(m_usedWords);)
+        {
+            if (bits != 0)
+            {
+                return static_cast<DataNumber>((word << kWordShift) + __builtin_ctzll(bits));
+            }
+            if (++word - m_baseWord < static_cast<int64_t>(m_usedWords))
+            {
+                bits = WordAt(word);
+            }
+        }
+        return MAX_DATANUMBER;
+    }
+
+    /// @return the number of pieces received beyond the prefix
+    size_t AheadCount() const
+    {
+        return m_aheadCnt;
+    }
+
+    void clear()
+    {
+        m_words.clear();
+        m_head = 0;
+        m_baseWord = 0;
+        m_usedWords = 0;
+        m_contiguousEnd = 0;
+        m_aheadCnt = 0;
+    }
+
+private:
+    static constexpr int64_t kWordShift = 6;
+    static constexpr int64_t kWordMask = 63;
+    static constexpr size_t kMinWords = 4;
+
+    uint64_t& WordAt(int64_t word)
+    {
+        return m_words[(m_head + (word - m_baseWord)) & (m_words.size() - 1)];
+    }
+
+    const uint64_t& WordAt(int64_t word) const
+    {
+        return m_words[(m_head + (word - m_baseWord)) & (m_words.size() - 1)];
+    }
+
+    /// the piece at the prefix end has arrived, move the prefix end to the next missing piece
+    void Advance()
+    {
+        // count the arrived piece ahead too, then take all the pieces the prefix end passes
+        ++m_aheadCnt;
+        while (m_words[m_head] == ~uint64_t(0))
+        {
+            // the word is complete, it leaves the ring
+            m_words[m_head] = 0;
+            m_head = (m_head + 1) & (m_words.size() - 1);
+            ++m_baseWord;
+            m_usedWords = m_usedWords > 0 ? m_usedWords - 1 : 0;
+        }
+        auto newEnd = static_cast<DataNumber>((m_baseWord << kWordShift) + __builtin_ctzll(~m_words[m_head]));
+        m_aheadCnt -= newEnd - m_contiguousEnd;
+        m_contiguousEnd = newEnd;
+    }
+
+    void Reserve(size_t words)
+    {
+        if (words <= m_words.size())
+        {
+            return;
+        }
+        size_t newCap = m_words.empty() ? kMinWords : m_words.size();
+        while (newCap < words)
+        {
+            newCap <<= 1U;
+        }
+        std::vector<uint64_t> newWords(newCap, 0);
+        for (size_t i = 0; i < m_usedWords; ++i)
+        {
+            newWords[i] = m_words[(m_head + i) & (m_words.size() - 1)];
+        }
+        m_words.swap(newWords);
+        m_head = 0;
+    }
+
+    std::vector<uint64_t> m_words;/** ring of bitmap words, capacity is a power of 2*/
+    size_t m_head{ 0 };/** ring index of m_baseWord*/
+    int64_t m_baseWord{ 0 };/** word number of the prefix end*/
+    size_t m_usedWords{ 0 };/** number of words in use, starting from m_baseWord*/
+    DataNumber m_contiguousEnd{ 0 };
+    size_t m_aheadCnt{ 0 };/** received pieces beyond the prefix end*/
+};
@@ -0,0 +1,296 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "basefw/base/hash.h"
+#include "basefw/base/log.h"
+#include "utils/transporttime.h"
+
+/// config of the shared bottleneck detection, the thresholds are the ones of RFC 8382
+struct SharedBottleneckConfig
+{
+    bool enabled{ true };
+    Duration interval{ Duration::FromMilliseconds(350) };/** T, the base interval of the summary statistics*/
+    uint32_t intervalCnt{ 50 };/** N, the statistics are over the last N intervals*/
+    uint32_t minIntervalCnt{ 10 };/** intervals needed before a session is grouped at all*/
+    double skewThresh{ -0.01 };/** c_s, a session with a lower skew is behind a bottleneck*/
+    double skewHysteresisThresh{ 0.3 };/** c_h, the skew threshold of a session with losses above lossThresh*/
+    double lossThresh{ 0.1 };/** p_l*/
+    double freqGroupThresh{ 0.1 };/** p_f*/
+    double varGroupThresh{ 0.1 };/** p_mad, relative*/
+    double skewGroupThresh{ 0.15 };/** p_s*/
+    double freqOscillationThresh{ 0.2 };/** p_v, in var_est, around the mean delay the interval means have to cross*/
+};
+
+/// summary statistics of the delay of one session, RFC 8382 section 3.1
+struct SbdSummary
+{
+    bool valid{ false };
+    double skewEst{ 0 };/** skew_est, in [-1, 1], low when the delay sticks above its mean*/
+    double varEst{ 0 };/** var_est, mean absolute deviation of the delay in us*/
+    double freqEst{ 0 };/** freq_est, crossings of the mean delay per interval*/
+    double lossRate{ 0 };/** pkt_loss*/
+};
+
+/// SbdDelayStats keeps the delay statistics of a session over a sliding window of intervals.
+/// Each delay sample is compared to the mean delay of the window when it arrives, so a sample costs O(1). The
+/// per interval sums are kept in a ring of intervalCnt entries, and the window sums are updated as an interval
+/// enters and leaves the ring, so the memory is fixed as well.
+/// The delay is the time from request to answer rather than a one-way delay, it varies the same way.
+class SbdDelayStats
+{
+public:
+    explicit SbdDelayStats(const SharedBottleneckConfig& config = SharedBottleneckConfig())
+            : m_config(config), m_ring(std::max(config.intervalCnt, 1U))
+    {
+    }
+
+    void OnDelaySample(Duration delay, Timepoint now)
+    {
+        CloseIntervals(now);
+        double delayUs = static_cast<double>(delay.ToMicroseconds());
+        m_cur.sumUs += delayUs;
+        ++m_cur.sampleCnt;
+        if (m_meanDelayUs > 0)
+        {
+            m_cur.skewBase += delayUs < m_meanDelayUs ? 1 : (delayUs > m_meanDelayUs ? -1 : 0);
+            m_cur.varBaseUs += std::fabs(delayUs - m_meanDelayUs);
+        }
+    }
+
+    void OnLoss(uint32_t lostCnt, Timepoint now)
+    {
+        CloseIntervals(now);
+        m_cur.lostCnt += lostCnt;
+    }
+
+    /// @return the statistics over the closed intervals of the window
+    SbdSummary Summary() const
+    {
+        SbdSummary summary;
+        summary.valid = m_filledCnt >= m_config.minIntervalCnt && m_window.sampleCnt > 0;
+        if (!summary.valid)
+        {
+            return summary;
+        }
+        summary.skewEst = m_window.skewBase / m_window.sampleCnt;
+        summary.varEst = m_window.varBaseUs / m_window.sampleCnt;
+        summary.freqEst = static_cast<double>(m_crossingCnt) / m_filledCnt;
+        summary.lossRate = static_cast<double>(m_window.lostCnt) / (m_window.sampleCnt + m_window.lostCnt);
+        return summary;
+    }
+
+private:
+    struct IntervalStats
+    {
+        double sumUs{ 0 };
+        uint64_t sampleCnt{ 0 };
+        double skewBase{ 0 };/** samples below the mean delay minus samples above it*/
+        double varBaseUs{ 0 };/** sum of the distances of the samples to the mean delay*/
+        uint64_t lostCnt{ 0 };
+        bool crossing{ false };/** the mean of this interval crossed the mean delay*/
+
+        void Add(const IntervalStats& other, double sign)
+        {
+            sumUs += sign * other.sumUs;
+            sampleCnt = sign > 0 ? sampleCnt + other.sampleCnt : sampleCnt - other.sampleCnt;
+            skewBase += sign * other.skewBase;
+            varBaseUs += sign * other.varBaseUs;
+            lostCnt = sign > 0 ? lostCnt + other.lostCnt : lostCnt - other.lostCnt;
+        }
+    };
+
+    void CloseIntervals(Timepoint now)
+    {
+        if (!m_intervalEnd.IsInitialized())
+        {
+            m_intervalEnd = now + m_config.interval;
+            return;
+        }
+        if (now < m_intervalEnd)
+        {
+            return;
+        }
+        if (now - m_intervalEnd > m_config.interval * static_cast<int>(m_ring.size()))
+        {
+            // nothing has been heard for longer than the window
+            Reset();
+            m_intervalEnd = now + m_config.interval;
+            return;
+        }
+        while (m_intervalEnd <= now)
+        {
+            CloseInterval();
+            m_intervalEnd = m_intervalEnd + m_config.interval;
+        }
+    }
+
+    void CloseInterval()
+    {
+        // the mean of the interval crosses the mean delay if it leaves the band on the other side than last time
+        if (m_cur.sampleCnt > 0 && m_meanDelayUs > 0)
+        {
+            double intervalMeanUs = m_cur.sumUs / m_cur.sampleCnt;
+            double varEstUs = m_window.sampleCnt > 0 ? m_window.varBaseUs / m_window.sampleCnt : 0;
+            double band = m_config.freqOscillationThresh * varEstUs;
+            int8_t side = intervalMeanUs > m_meanDelayUs + band ? 1 : (intervalMeanUs < m_meanDelayUs - band ? -1 : 0);
+            if (side != 0)
+            {
+                m_cur.crossing = m_lastSide != 0 && side != m_lastSide;
+                m_lastSide = side;
+            }
+        }
+
+        IntervalStats& slot = m_ring[m_head];
+        if (m_filledCnt == m_ring.size())
+        {
+            m_window.Add(slot, -1);
+            m_crossingCnt -= slot.crossing ? 1 : 0;
+        }
+        else
+        {
+            ++m_filledCnt;
+        }
+        slot = m_cur;
+        m_window.Add(slot, 1);
+        m_crossingCnt += slot.crossing ? 1 : 0;
+        m_head = (m_head + 1) % m_ring.size();
+        m_cur = IntervalStats();
+        m_meanDelayUs = m_window.sampleCnt > 0 ? m_window.sumUs / m_window.sampleCnt : 0;
+    }
+
+    void Reset()
+    {
+        std::fill(m_ring.begin(), m_ring.end(), IntervalStats());
+        m_head = 0;
+        m_filledCnt = 0;
+        m_cur = IntervalStats();
+        m_window = IntervalStats();
+        m_crossingCnt = 0;
+        m_meanDelayUs = 0;
+        m_lastSide = 0;
+    }
+
+    SharedBottleneckConfig m_config;
+    std::vector<IntervalStats> m_ring;/** the closed intervals of the window*/
+    size_t m_head{ 0 };/** the slot the next closed interval goes to*/
+    size_t m_filledCnt{ 0 };
+    IntervalStats m_cur;/** the interval in progress*/
+    IntervalStats m_window;/** sums over the ring*/
+    uint32_t m_crossingCnt{ 0 };
+    double m_meanDelayUs{ 0 };/** mean_delay over the window, 0 until an interval with samples has closed*/
+    int8_t m_lastSide{ 0 };/** the side of the mean delay the last interval mean left the band on*/
+    Timepoint m_intervalEnd{ Timepoint::Zero() };
+};
+
+/// SharedBottleneckDetector groups the sessions of a task which are behind the same bottleneck, RFC 8382 section 3.3.
+/// Only the sessions found behind a bottleneck are grouped, they are split by freq_est, then var_est, then skew_est
+/// wherever neighbouring values differ by more than the thresholds. Every other session is in a group of its own,
+/// and a session without enough samples yet stays in kUnknownGroup, which it shares with the other unknown ones.
+class SharedBottleneckDetector
+{
+public:
+    enum : uint32_t
+    {
+        kUnknownGroup = 0
+    };
+
+    explicit SharedBottleneckDetector(const SharedBottleneckConfig& config = SharedBottleneckConfig())
+            : m_config(config)
+    {
+    }
+
+    /// @return the group of each session, from the summaries of all sessions
+    std::map<fw::ID, uint32_t> Group(const std::map<fw::ID, SbdSummary>& summaries) const
+    {
+        std::map<fw::ID, uint32_t> groups;
+        std::vector<Member> bottlenecked;
+        uint32_t nextGroup = kUnknownGroup + 1;
+        for (auto&& id_summary: summaries)
+        {
+            const SbdSummary& summary = id_summary.second;
+            if (!summary.valid)
+            {
+                groups[id_summary.first] = kUnknownGroup;
+            }
+            else if (summary.skewEst < m_config.skewThresh ||
+                     (summary.skewEst < m_config.skewHysteresisThresh && summary.lossRate > m_config.lossThresh))
+            {
+                bottlenecked.push_back(Member{ id_summary.first, summary });
+            }
+            else
+            {
+                groups[id_summary.first] = nextGroup++;
+            }
+        }
+
+        std::vector<std::vector<Member>> clusters{ bottlenecked };
+        clusters = Split(clusters, [](const SbdSummary& s) { return s.freqEst; },
+                [this](double, double) { return m_config.freqGroupThresh; });
+        clusters = Split(clusters, [](const SbdSummary& s) { return s.varEst; },
+                [this](double, double larger) { return m_config.varGroupThresh * larger; });
+        clusters = Split(clusters, [](const SbdSummary& s) { return s.skewEst; },
+                [this](double, double) { return m_config.skewGroupThresh; });
+        for (auto&& cluster: clusters)
+        {
+            if (cluster.empty())
+            {
+                continue;
+            }
+            for (auto&& member: cluster)
+            {
+                groups[member.sessionId] = nextGroup;
+            }
+            SPDLOG_DEBUG("group {}: {} sessions behind a shared bottleneck", nextGroup, cluster.size());
+            ++nextGroup;
+        }
+        return groups;
+    }
+
+private:
+    struct Member
+    {
+        fw::ID sessionId;
+        SbdSummary summary;
+    };
+
+    /// sort each cluster by key and split it where neighbouring keys differ by more than thresh(smaller, larger)
+    template<class Key, class Thresh>
+    static std::vector<std::vector<Member>> Split(const std::vector<std::vector<Member>>& clusters, Key key,
+            Thresh thresh)
+    {
+        std::vector<std::vector<Member>> result;
+        for (auto cluster: clusters)
+        {
+            if (cluster.empty())
+            {
+                continue;
+            }
+            std::sort(cluster.begin(), cluster.end(), [&key](const Member& a, const Member& b) {
+                return key(a.summary) < key(b.summary);
+            });
+            result.emplace_back();
+            for (size_t i = 0; i < cluster.size(); ++i)
+            {
+                if (i > 0)
+                {
+                    double smaller = key(cluster[i - 1].summary);
+                    double larger = key(cluster[i].summary);
+                    if (larger - smaller > thresh(smaller, larger))
+                    {
+                        result.emplace_back();
+                    }
+                }
+                result.back().push_back(cluster[i]);
+            }
+        }
+        return result;
+    }
+
+    SharedBottleneckConfig m_config;
+};
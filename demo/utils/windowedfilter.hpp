@@ -0,0 +1,117 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+
+/// compare functions for WindowedFilter
+template<class T>
+struct MaxFilter
+{
+    bool operator()(const T& lhs, const T& rhs) const
+    {
+        return lhs >= rhs;
+    }
+};
+
+template<class T>
+struct MinFilter
+{
+    bool operator()(const T& lhs, const T& rhs) const
+    {
+        return lhs <= rhs;
+    }
+};
+
+/// Windowed min/max filter, keeping the best, second best and third best samples of the window
+/// (Kathleen Nichols' algorithm, the same one as WindowedFilter in quiche and win_minmax in Linux).
+/// Time is any monotonic int64 counter, e.g. microseconds or round trip counts.
+template<class T, class Compare>
+class WindowedFilter
+{
+public:
+    WindowedFilter(int64_t windowLength, T zeroValue)
+            : m_windowLength(windowLength), m_zeroValue(zeroValue)
+    {
+        Reset(zeroValue, 0);
+    }
+
+    void SetWindowLength(int64_t windowLength)
+    {
+        m_windowLength = windowLength;
+    }
+
+    void Update(T newSample, int64_t newTime)
+    {
+        // reset all estimates if there is no estimate yet, the new sample is the best, or the third best expired
+        if (m_estimates[0].sample == m_zeroValue || Compare()(newSample, m_estimates[0].sample) ||
+            newTime - m_estimates[2].time > m_windowLength)
+        {
+            Reset(newSample, newTime);
+            return;
+        }
+
+        if (Compare()(newSample, m_estimates[1].sample))
+        {
+            m_estimates[1] = Sample(newSample, newTime);
+            m_estimates[2] = m_estimates[1];
+        }
+        else if (Compare()(newSample, m_estimates[2].sample))
+        {
+            m_estimates[2] = Sample(newSample, newTime);
+        }
+
+        // expire the best estimate and shift the others
+        if (newTime - m_estimates[0].time > m_windowLength)
+        {
+            m_estimates[0] = m_estimates[1];
+            m_estimates[1] = m_estimates[2];
+            m_estimates[2] = Sample(newSample, newTime);
+            if (newTime - m_estimates[0].time > m_windowLength)
+            {
+                m_estimates[0] = m_estimates[1];
+                m_estimates[1] = m_estimates[2];
+            }
+            return;
+        }
+        // keep the second and third best estimates from different quarters of the window
+        if (m_estimates[1].sample == m_estimates[0].sample && newTime - m_estimates[1].time > m_windowLength / 4)
+        {
+            m_estimates[2] = m_estimates[1] = Sample(newSample, newTime);
+            return;
+        }
+        if (m_estimates[2].sample == m_estimates[1].sample && newTime - m_estimates[2].time > m_windowLength / 2)
+        {
+            m_estimates[2] = Sample(newSample, newTime);
+        }
+    }
+
+    void Reset(T newSample, int64_t newTime)
+    {
+        m_estimates[0] = m_estimates[1] = m_estimates[2] = Sample(newSample, newTime);
+    }
+
+    T GetBest() const
+    {
+        return m_estimates[0].sample;
+    }
+
+private:
+    struct Sample
+    {
+        T sample;
+        int64_t time;
+
+        Sample() : sample(), time(0)
+        {
+        }
+
+        Sample(T initSample, int64_t initTime) : sample(initSample), time(initTime)
+        {
+        }
+    };
+
+    int64_t m_windowLength;
+    T m_zeroValue;
+    Sample m_estimates[3];
+};
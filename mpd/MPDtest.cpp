@@ -62,6 +62,11 @@ int main(int argc, char** argv)
     //// CUBIC
     std::shared_ptr<CubicTransportCtlConfig> myTransportCtlConfig = std::make_shared<CubicTransportCtlConfig>();
     // these values will be passed to demo transport module
+    // uncomment the line below to schedule pieces by their playback deadline
+//    myTransportCtlConfig->multipathSchedulerType = MultiPathSchedulerType::MULTI_PATH_SCHEDULE_DEADLINE;
+    // uncomment the lines below to use BBR, which relies on pacing instead of loss to keep the queue short
+//    myTransportCtlConfig->congestionCtlType = CongestionCtlType::bbr;
+//    myTransportCtlConfig->pacingEnabled = true;
 
 
     // Create your TransportCtlFactory
@@ -0,0 +1,136 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+// basefw::ID is part of the prebuilt download module, which the simulator doesn't link.
+// This is the part of it the transport controllers use.
+
+#include <cstring>
+#include "basefw/base/hash.h"
+
+namespace basefw
+{
+    const ID ID::EmptyID;
+
+    ID::ID()
+    {
+        Reset();
+    }
+
+    ID::ID(uint8_t b[20])
+    {
+        memcpy(ID_20_, b, m_buffer_len);
+    }
+
+    ID::ID(const std::string& idstr)
+    {
+        if (!Parse(idstr))
+        {
+            Reset();
+        }
+    }
+
+    ID::ID(const basefw::ID& id)
+    {
+        memcpy(ID_20_, id.ID_20_, m_buffer_len);
+    }
+
+    ID& ID::operator=(const ID& id)
+    {
+        memcpy(ID_20_, id.ID_20_, m_buffer_len);
+        return *this;
+    }
+
+    std::string ID::ToStr() const
+    {
+        char ascii[m_buffer_len * 2 + 1] = { 0 };
+        BCDtoASCII(ID_20_, m_buffer_len, ascii);
+        return std::string(ascii);
+    }
+
+    std::string ID::ToLogStr() const
+    {
+        // the simulator puts the distinguishing bytes first
+        return ToStr().substr(0, 8);
+    }
+
+    bool ID::IsEmpty() const
+    {
+        return *this == EmptyID;
+    }
+
+    void ID::Reset()
+    {
+        memset(ID_20_, 0, m_buffer_len);
+    }
+
+    uint8_t* ID::Getbuf()
+    {
+        return ID_20_;
+    }
+
+    const uint8_t* ID::Getbuf() const
+    {
+        return ID_20_;
+    }
+
+    bool ID::operator==(const ID& id) const
+    {
+        return memcmp(ID_20_, id.ID_20_, m_buffer_len) == 0;
+    }
+
+    bool ID::operator!=(const ID& id) const
+    {
+        return !(*this == id);
+    }
+
+    bool ID::operator<(const ID& id) const
+    {
+        return memcmp(ID_20_, id.ID_20_, m_buffer_len) < 0;
+    }
+
+    bool ID::Parse(const std::string& idstr)
+    {
+        if (idstr.size() != m_buffer_len * 2)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < m_buffer_len; ++i)
+        {
+            int32_t high = ctoi(idstr[2 * i]);
+            int32_t low = ctoi(idstr[2 * i + 1]);
+            if (high < 0 || low < 0)
+            {
+                return false;
+            }
+            ID_20_[i] = static_cast<uint8_t>(high << 4 | low);
+        }
+        return true;
+    }
+
+    int32_t ID::ctoi(char ch)
+    {
+        if (ch >= '0' && ch <= '9')
+        {
+            return ch - '0';
+        }
+        if (ch >= 'a' && ch <= 'f')
+        {
+            return ch - 'a' + 10;
+        }
+        if (ch >= 'A' && ch <= 'F')
+        {
+            return ch - 'A' + 10;
+        }
+        return -1;
+    }
+
+    void ID::BCDtoASCII(const uint8_t* str, int strlen, char* ascii)
+    {
+        static const char kHex[] = "0123456789abcdef";
+        for (int i = 0; i < strlen; ++i)
+        {
+            ascii[2 * i] = kHex[str[i] >> 4];
+            ascii[2 * i + 1] = kHex[str[i] & 0x0f];
+        }
+        ascii[2 * strlen] = '\0';
+    }
+}
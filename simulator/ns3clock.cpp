@@ -0,0 +1,38 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#include "ns3clock.hpp"
+
+NS3Clock* NS3Clock::GetClock()
+{
+    static NS3Clock* clock = new NS3Clock();
+    return clock;
+}
+
+QuicTime NS3Clock::ApproximateNow() const
+{
+    return Now();
+}
+
+QuicTime NS3Clock::Now() const
+{
+    return m_now;
+}
+
+QuicWallTime NS3Clock::WallNow() const
+{
+    return QuicWallTime::FromUNIXMicroseconds((m_now - QuicTime::Zero()).ToMicroseconds());
+}
+
+QuicTime NS3Clock::ConvertWallTimeToQuicTime(
+        const QuicWallTime& walltime) const
+{
+    return CreateTimeFromMicroseconds(walltime.ToUNIXMicroseconds());
+}
+
+void NS3Clock::AdvanceTo(QuicTime t)
+{
+    if (t > m_now)
+    {
+        m_now = t;
+    }
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+
+#include "demo/utils/thirdparty/quiche/quic_clock.h"
+
+using basefw::quic::QuicClock;
+using basefw::quic::QuicTime;
+using basefw::quic::QuicWallTime;
+
+/// Virtual clock of the simulator, selected by USE_NS3 in transporttime.h.
+/// Time doesn't flow by itself, it's moved forward by SimEventLoop before each event is handled.
+class NS3Clock : public QuicClock
+{
+public:
+    static NS3Clock* GetClock();
+
+    explicit NS3Clock() = default;
+
+    ~NS3Clock() override = default;
+
+    NS3Clock(const NS3Clock&) = delete;
+
+    NS3Clock& operator=(const NS3Clock&) = delete;
+
+    // QuicClock implementation.
+    QuicTime ApproximateNow() const override;
+
+    /// virtual time
+    QuicTime Now() const override;
+
+    /// virtual time since the UNIX epoch
+    QuicWallTime WallNow() const override;
+
+    QuicTime ConvertWallTimeToQuicTime(
+            const QuicWallTime& walltime) const override;
+
+    /// move the clock forward to t, the clock never goes back
+    void AdvanceTo(QuicTime t);
+
+private:
+    /// start from 1s, so that no valid time point equals to QuicTime::Zero()
+    QuicTime m_now{ QuicTime::Zero() + QuicTime::Delta::FromSeconds(1) };
+};
@@ -0,0 +1,246 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "transportcontroller.hpp"
+#include "packettype.h"
+#include "simeventloop.hpp"
+#include "simnetwork.hpp"
+
+/// result of one download
+struct SimDownloadStats
+{
+    bool finished{ false };
+    Duration downloadTime{ Duration::Zero() };/** from the task start to the last piece received*/
+    uint64_t requestPkts{ 0 };
+    uint64_t requestedPieces{ 0 };
+    uint64_t receivedPieces{ 0 };/** duplicates included*/
+    uint64_t duplicatePieces{ 0 };
+    std::vector<uint64_t> serverPieces;/** pieces received from each server*/
+    std::vector<Duration> serverMaxGap;/** longest time without a piece from each server, e.g. across an outage*/
+};
+
+/// SimDownloader plays the download task and the upload side servers for one client.
+/// It's the MPDTransCtlHandler of the transport controller. Data requests go up the simulated path, each
+/// requested piece comes back as one packet, and everything the SDK does asynchronously is scheduled as an event.
+class SimDownloader : public MPDTransCtlHandler, public std::enable_shared_from_this<SimDownloader>
+{
+public:
+    static constexpr uint32_t kRequestHeaderSize = 64;/** bytes of a data request without the piece numbers*/
+    static constexpr uint32_t kDataPktOverhead = 64;/** bytes of headers in a data packet*/
+
+    SimDownloader(SimEventLoop& loop, SimNetwork& network, size_t client, uint64_t fileLength,
+            Duration alarmInterval)
+            : m_loop(loop), m_network(network), m_client(client), m_fileLength(fileLength),
+              m_alarmInterval(alarmInterval)
+    {
+        m_pieceCnt = static_cast<int32_t>((fileLength + kDataPieceSize - 1) / kDataPieceSize);
+        m_received.assign(m_pieceCnt, false);
+        for (size_t server = 0; server < m_network.ServerCount(); ++server)
+        {
+            m_sessionIds.push_back(MakeId(0x5e, client, server));
+        }
+        m_nextSeq.assign(m_sessionIds.size(), 0);
+        m_lastRecv.assign(m_sessionIds.size(), Timepoint::Zero());
+        m_destroyed.assign(m_sessionIds.size(), 0);
+        m_stats.serverPieces.assign(m_sessionIds.size(), 0);
+        m_stats.serverMaxGap.assign(m_sessionIds.size(), Duration::Zero());
+    }
+
+    ~SimDownloader() override = default;
+
+    /// start the controller, create a session for each server and start the task
+    void Start(std::shared_ptr<MPDTransportController> controller)
+    {
+        m_controller = controller;
+        m_startTic = m_loop.Now();
+        m_lastRecv.assign(m_sessionIds.size(), m_startTic);
+
+        TransportDownloadTaskInfo taskInfo;
+        taskInfo.m_rid = MakeId(0x7a, m_client, 0);
+        taskInfo.m_filelength = m_fileLength;
+        m_controller->StartTransportController(taskInfo, shared_from_this());
+        for (auto&& sessionid: m_sessionIds)
+        {
+            m_controller->OnSessionCreate(sessionid);
+        }
+        m_controller->OnDownloadTaskStart();
+        ScheduleAlarm();
+    }
+
+    bool DoSendDataRequest(const fw::ID& sessionid, const std::vector<int32_t>& datapieces) override
+    {
+        size_t server = ServerIndex(sessionid);
+        if (m_stats.finished || server >= m_sessionIds.size() || m_destroyed[server] || datapieces.empty())
+        {
+            return false;
+        }
+        std::vector<uint32_t> seqvec;
+        for (size_t i = 0; i < datapieces.size(); ++i)
+        {
+            seqvec.push_back(m_nextSeq[server]++);
+        }
+        ++m_stats.requestPkts;
+        m_stats.requestedPieces += datapieces.size();
+
+        // the SDK tells the packet is sent after this call returns
+        uint64_t senttic = NowUs();
+        m_loop.ScheduleIn(Duration::Zero(), [this, sessionid, datapieces, seqvec, senttic]() {
+            if (!m_stats.finished)
+            {
+                m_controller->OnDataSent(sessionid, datapieces, seqvec, senttic);
+            }
+        });
+
+        uint32_t requestBytes = kRequestHeaderSize + static_cast<uint32_t>(datapieces.size() * sizeof(int32_t));
+        m_network.SendToServer(m_client, server, requestBytes, [this, server, datapieces, seqvec]() {
+            OnRequestArrived(server, datapieces, seqvec);
+        });
+        return true;
+    }
+
+    bool DoRequestDatapiecesTask(uint32_t piecesnum) override
+    {
+        if (m_stats.finished || m_nextTaskPiece >= m_pieceCnt)
+        {
+            return false;
+        }
+        std::vector<int32_t> datapieces;
+        while (datapieces.size() < piecesnum && m_nextTaskPiece < m_pieceCnt)
+        {
+            datapieces.push_back(m_nextTaskPiece++);
+        }
+        m_loop.ScheduleIn(Duration::Zero(), [this, datapieces]() mutable {
+            if (!m_stats.finished)
+            {
+                m_controller->OnPieceTaskAdding(datapieces);
+            }
+        });
+        return true;
+    }
+
+    /// the session to the server goes away, the data still on the way from the server is dropped
+    void DestroySession(size_t server)
+    {
+        if (m_stats.finished || server >= m_sessionIds.size() || m_destroyed[server])
+        {
+            return;
+        }
+        m_destroyed[server] = 1;
+        m_controller->OnSessionDestory(m_sessionIds[server]);
+    }
+
+    bool Finished() const
+    {
+        return m_stats.finished;
+    }
+
+    const SimDownloadStats& GetStats() const
+    {
+        return m_stats;
+    }
+
+private:
+    static fw::ID MakeId(uint8_t tag, size_t client, size_t server)
+    {
+        uint8_t buf[20] = { 0 };
+        buf[0] = tag;
+        buf[1] = static_cast<uint8_t>(client);
+        buf[2] = static_cast<uint8_t>(server);
+        return fw::ID(buf);
+    }
+
+    size_t ServerIndex(const fw::ID& sessionid) const
+    {
+        for (size_t server = 0; server < m_sessionIds.size(); ++server)
+        {
+            if (m_sessionIds[server] == sessionid)
+            {
+                return server;
+            }
+        }
+        return m_sessionIds.size();
+    }
+
+    uint64_t NowUs() const
+    {
+        return static_cast<uint64_t>((m_loop.Now() - Timepoint::Zero()).ToMicroseconds());
+    }
+
+    /// the server answers each requested piece with one data packet
+    void OnRequestArrived(size_t server, const std::vector<int32_t>& datapieces, const std::vector<uint32_t>& seqvec)
+    {
+        for (size_t i = 0; i < datapieces.size(); ++i)
+        {
+            int32_t datapiece = datapieces[i];
+            uint32_t seq = seqvec[i];
+            m_network.SendToClient(m_client, server, kDataPieceSize + kDataPktOverhead,
+                    [this, server, seq, datapiece]() {
+                        OnDataArrived(server, seq, datapiece);
+                    });
+        }
+    }
+
+    void OnDataArrived(size_t server, uint32_t seq, int32_t datapiece)
+    {
+        if (m_stats.finished || m_destroyed[server])
+        {
+            return;
+        }
+        ++m_stats.receivedPieces;
+        ++m_stats.serverPieces[server];
+        m_stats.serverMaxGap[server] = std::max(m_stats.serverMaxGap[server], m_loop.Now() - m_lastRecv[server]);
+        m_lastRecv[server] = m_loop.Now();
+        if (datapiece < 0 || datapiece >= m_pieceCnt || m_received[datapiece])
+        {
+            ++m_stats.duplicatePieces;
+        }
+        else
+        {
+            m_received[datapiece] = true;
+            ++m_receivedCnt;
+        }
+        m_controller->OnDataPiecesReceived(m_sessionIds[server], seq, datapiece, NowUs());
+
+        if (m_receivedCnt == m_pieceCnt)
+        {
+            m_stats.finished = true;
+            m_stats.downloadTime = m_loop.Now() - m_startTic;
+            m_controller->OnDownloadTaskStop();
+        }
+    }
+
+    void ScheduleAlarm()
+    {
+        m_loop.ScheduleIn(m_alarmInterval, [this]() {
+            if (m_stats.finished)
+            {
+                return;
+            }
+            m_controller->OnLossDetectionAlarm();
+            ScheduleAlarm();
+        });
+    }
+
+    SimEventLoop& m_loop;
+    SimNetwork& m_network;
+    size_t m_client;
+    uint64_t m_fileLength;
+    Duration m_alarmInterval;
+    std::shared_ptr<MPDTransportController> m_controller;
+
+    std::vector<fw::ID> m_sessionIds;/** one session to each server, indexed by server*/
+    std::vector<uint32_t> m_nextSeq;/** by server*/
+    std::vector<Timepoint> m_lastRecv;/** by server*/
+    std::vector<char> m_destroyed;/** by server*/
+    int32_t m_pieceCnt{ 0 };
+    int32_t m_nextTaskPiece{ 0 };
+    int32_t m_receivedCnt{ 0 };
+    std::vector<bool> m_received;
+
+    Timepoint m_startTic{ Timepoint::Zero() };
+    SimDownloadStats m_stats;
+};
@@ -0,0 +1,84 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "utils/transporttime.h"
+
+#ifndef USE_NS3
+#error "the simulator runs on the virtual clock, build it with USE_NS3"
+#endif
+
+/// Discrete event loop driving the virtual clock.
+/// Events run in time order, events scheduled at the same time run in the order they are scheduled, so a run is
+/// fully determined by its inputs.
+class SimEventLoop
+{
+public:
+    using Handler = std::function<void()>;
+
+    Timepoint Now() const
+    {
+        return Clock::GetClock()->Now();
+    }
+
+    /// events in the past run at the current time
+    void Schedule(Timepoint at, Handler handler)
+    {
+        m_events.push(Event{ std::max(at, Now()), m_nextEventId++, std::move(handler) });
+    }
+
+    void ScheduleIn(Duration delay, Handler handler)
+    {
+        Schedule(Now() + delay, std::move(handler));
+    }
+
+    /// run until there is no event, Stop() is called or the clock reaches until
+    void Run(Timepoint until)
+    {
+        m_stopped = false;
+        while (!m_stopped && !m_events.empty() && m_events.top().at <= until)
+        {
+            // the handler may schedule new events, so take it out first
+            Event event = m_events.top();
+            m_events.pop();
+            Clock::GetClock()->AdvanceTo(event.at);
+            event.handler();
+            ++m_handledEvents;
+        }
+    }
+
+    void Stop()
+    {
+        m_stopped = true;
+    }
+
+    uint64_t HandledEvents() const
+    {
+        return m_handledEvents;
+    }
+
+private:
+    struct Event
+    {
+        Timepoint at;
+        uint64_t id;
+        Handler handler;
+    };
+
+    struct Later
+    {
+        bool operator()(const Event& lhs, const Event& rhs) const
+        {
+            return lhs.at > rhs.at || (lhs.at == rhs.at && lhs.id > rhs.id);
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, Later> m_events;
+    uint64_t m_nextEventId{ 0 };
+    uint64_t m_handledEvents{ 0 };
+    bool m_stopped{ false };
+};
@@ -0,0 +1,117 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <utility>
+#include <vector>
+#include "utils/transporttime.h"
+
+/// one direction of a link, with the same parameters as a mininet TCLink
+struct SimLinkConfig
+{
+    double bwMbps{ 0 };/** 0 means no bandwidth limit*/
+    Duration delay{ Duration::FromMilliseconds(2) };
+    Duration jitter{ Duration::Zero() };/** extra delay drawn uniformly from [0, jitter), packets may be reordered*/
+    uint32_t maxQueueSize{ 1000 };/** in packets, the packet being transmitted included*/
+    double lossPercent{ 0 };
+    std::vector<std::pair<Duration, Duration>> outages;/** [start, end) after the simulation start, end may be infinite*/
+};
+
+/// A FIFO link with a drop tail queue. A packet waits for the packets ahead of it, takes bytes / bandwidth to be
+/// transmitted, then arrives delay plus a random jitter later. It may be dropped by the full queue, by random loss or
+/// by an outage.
+class SimLink
+{
+public:
+    SimLink(const SimLinkConfig& config, Timepoint startTime, uint64_t seed)
+            : m_config(config), m_startTime(startTime), m_rng(seed), m_lossDist(0.0, 100.0)
+    {
+    }
+
+    /// @param arrival when the packet reaches the other end, if it's not dropped
+    /// @return false if the packet is dropped
+    bool Transmit(uint32_t bytes, Timepoint now, Timepoint& arrival)
+    {
+        if (IsDown(now))
+        {
+            ++m_outageDrops;
+            return false;
+        }
+        while (!m_departures.empty() && m_departures.front() <= now)
+        {
+            m_departures.pop_front();
+        }
+        if (m_departures.size() >= m_config.maxQueueSize)
+        {
+            ++m_queueDrops;
+            return false;
+        }
+        if (m_config.lossPercent > 0 && m_lossDist(m_rng) < m_config.lossPercent)
+        {
+            ++m_randomDrops;
+            return false;
+        }
+
+        Timepoint departure = now;
+        if (m_config.bwMbps > 0)
+        {
+            Timepoint start = std::max(now, m_busyUntil);
+            departure = start + Duration::FromMicroseconds(static_cast<int64_t>(bytes * 8 / m_config.bwMbps));
+            m_busyUntil = departure;
+            m_departures.push_back(departure);
+        }
+        arrival = departure + m_config.delay;
+        if (!m_config.jitter.IsZero())
+        {
+            arrival = arrival + Duration::FromMicroseconds(
+                    static_cast<int64_t>(m_lossDist(m_rng) / 100.0 * m_config.jitter.ToMicroseconds()));
+        }
+        ++m_sentPkts;
+        return true;
+    }
+
+    bool IsDown(Timepoint now) const
+    {
+        for (auto&& outage: m_config.outages)
+        {
+            if (now >= m_startTime + outage.first &&
+                (outage.second.IsInfinite() || now < m_startTime + outage.second))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t SentPkts() const
+    {
+        return m_sentPkts;
+    }
+
+    uint64_t DroppedPkts() const
+    {
+        return m_queueDrops + m_randomDrops + m_outageDrops;
+    }
+
+    uint64_t QueueDrops() const
+    {
+        return m_queueDrops;
+    }
+
+private:
+    SimLinkConfig m_config;
+    Timepoint m_startTime;
+    std::mt19937_64 m_rng;
+    std::uniform_real_distribution<double> m_lossDist;
+
+    Timepoint m_busyUntil{ Timepoint::Zero() };
+    std::deque<Timepoint> m_departures;/** departure time of each packet in the queue*/
+
+    uint64_t m_sentPkts{ 0 };
+    uint64_t m_queueDrops{ 0 };
+    uint64_t m_randomDrops{ 0 };
+    uint64_t m_outageDrops{ 0 };
+};
@@ -0,0 +1,375 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+/// mpdsim runs the transport controllers in demo/ over a simulated mininet topology, in virtual time.
+/// usage: mpdsim [--topo topo-1..topo-5] [--ctl demo|cubic] [--cc reno|cubic|bbr|copa|lia|olia|balia]
+///               [--sched rr|deadline|stripe|ecf] [--lossdetect rto|ackbased] [--pacing] [--no-endgame]
+///               [--no-oppretrans] [--no-health] [--no-undo] [--no-hystart] [--no-prr] [--lossdiff] [--outage s]
+///               [--destroy s] [--jitter ms] [--seed n] [--size bytes] [--alarm ms] [--until s]
+/// --outage makes the link cut in topo-5 come back after so many seconds.
+/// --destroy destroys the session to the last server after so many seconds.
+/// --jitter adds a random delay of up to so many ms to each server link.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "spdlog/spdlog.h"
+#include "demotransportcontroller.hpp"
+#include "cubictransportcontroller.hpp"
+#include "simdownloader.hpp"
+#include "simeventloop.hpp"
+#include "simnetwork.hpp"
+#include "simscenarios.hpp"
+
+struct SimOptions
+{
+    std::string topo{ "topo-1" };
+    std::string ctl{ "demo" };
+    std::string cc;/** empty means the default of the controller*/
+    std::string sched{ "rr" };
+    std::string lossdetect{ "rto" };
+    bool pacing{ false };
+    bool endgame{ true };
+    bool oppRetrans{ true };
+    bool health{ true };
+    bool spuriousLossUndo{ true };
+    bool hystart{ true };
+    bool prr{ true };
+    bool lossDiff{ false };
+    uint32_t outageS{ 0 };/** 0 keeps the outages of the topology as they are*/
+    uint32_t destroyS{ 0 };/** 0 keeps all sessions*/
+    uint32_t jitterMs{ 0 };
+    uint64_t seed{ 1 };
+    uint64_t size{ 10 * 1024 * 1024 };
+    uint32_t alarmMs{ 100 };
+    uint32_t untilS{ 600 };
+};
+
+static void Usage()
+{
+    std::cerr << "usage: mpdsim [--topo topo-1..topo-5] [--ctl demo|cubic] [--cc reno|cubic|bbr|copa|lia|olia|balia]"
+                 " [--sched rr|deadline|stripe|ecf] [--lossdetect rto|ackbased] [--pacing] [--no-endgame]"
+                 " [--no-oppretrans] [--no-health] [--no-undo] [--no-hystart] [--no-prr] [--lossdiff] [--outage s]"
+                 " [--destroy s] [--jitter ms] [--seed n] [--size bytes] [--alarm ms] [--until s]"
+              << std::endl;
+}
+
+static bool ParseOptions(int argc, char* argv[], SimOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--pacing")
+        {
+            options.pacing = true;
+            continue;
+        }
+        if (arg == "--no-endgame")
+        {
+            options.endgame = false;
+            continue;
+        }
+        if (arg == "--no-oppretrans")
+        {
+            options.oppRetrans = false;
+            continue;
+        }
+        if (arg == "--no-health")
+        {
+            options.health = false;
+            continue;
+        }
+        if (arg == "--no-undo")
+        {
+            options.spuriousLossUndo = false;
+            continue;
+        }
+        if (arg == "--no-hystart")
+        {
+            options.hystart = false;
+            continue;
+        }
+        if (arg == "--no-prr")
+        {
+            options.prr = false;
+            continue;
+        }
+        if (arg == "--lossdiff")
+        {
+            options.lossDiff = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--topo")
+        {
+            options.topo = value;
+        }
+        else if (arg == "--ctl")
+        {
+            options.ctl = value;
+        }
+        else if (arg == "--cc")
+        {
+            options.cc = value;
+        }
+        else if (arg == "--sched")
+        {
+            options.sched = value;
+        }
+        else if (arg == "--lossdetect")
+        {
+            options.lossdetect = value;
+        }
+        else if (arg == "--seed")
+        {
+            options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (arg == "--size")
+        {
+            options.size = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (arg == "--alarm")
+        {
+            options.alarmMs = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (arg == "--outage")
+        {
+            options.outageS = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (arg == "--destroy")
+        {
+            options.destroyS = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (arg == "--jitter")
+        {
+            options.jitterMs = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (arg == "--until")
+        {
+            options.untilS = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.size > 0 && options.alarmMs > 0;
+}
+
+/// DemoTransportCtlConfig and CubicTransportCtlConfig share these fields
+template<class CtlConfig>
+static bool ApplyOptions(const SimOptions& options, CtlConfig& config)
+{
+    if (options.cc == "reno")
+    {
+        config.congestionCtlType = CongestionCtlType::reno;
+    }
+    else if (options.cc == "cubic")
+    {
+        config.congestionCtlType = CongestionCtlType::cubic;
+    }
+    else if (options.cc == "bbr")
+    {
+        config.congestionCtlType = CongestionCtlType::bbr;
+    }
+    else if (options.cc == "copa")
+    {
+        config.congestionCtlType = CongestionCtlType::copa;
+    }
+    else if (options.cc == "lia" || options.cc == "olia" || options.cc == "balia")
+    {
+        config.congestionCtlType = CongestionCtlType::coupled;
+        config.coupledConfig.algo = options.cc == "lia" ? CoupledAlgoType::lia
+                : options.cc == "olia" ? CoupledAlgoType::olia : CoupledAlgoType::balia;
+    }
+    else if (!options.cc.empty())
+    {
+        return false;
+    }
+
+    if (options.sched == "rr")
+    {
+        config.multipathSchedulerType = MultiPathSchedulerType::MULTI_PATH_SCHEDULE_RR;
+    }
+    else if (options.sched == "deadline")
+    {
+        config.multipathSchedulerType = MultiPathSchedulerType::MULTI_PATH_SCHEDULE_DEADLINE;
+    }
+    else if (options.sched == "stripe")
+    {
+        config.multipathSchedulerType = MultiPathSchedulerType::MULTI_PATH_SCHEDULE_STRIPE;
+    }
+    else if (options.sched == "ecf")
+    {
+        config.multipathSchedulerType = MultiPathSchedulerType::MULTI_PATH_SCHEDULE_ECF;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (options.lossdetect == "rto")
+    {
+        config.lossDetectType = LossDetectionType::rto;
+    }
+    else if (options.lossdetect == "ackbased")
+    {
+        config.lossDetectType = LossDetectionType::ackbased;
+    }
+    else
+    {
+        return false;
+    }
+    config.pacingEnabled = options.pacing;
+    config.endgameConfig.enabled = options.endgame;
+    config.oppRetransConfig.enabled = options.oppRetrans;
+    config.sessionHealthConfig.enabled = options.health;
+    config.spuriousLossUndo = options.spuriousLossUndo;
+    config.hystartEnabled = options.hystart;
+    config.prrEnabled = options.prr;
+    config.lossDifferentiationConfig.enabled = options.lossDiff;
+    return true;
+}
+
+static std::shared_ptr<MPDTransportController> MakeController(const SimOptions& options)
+{
+    if (options.ctl == "demo")
+    {
+        auto config = std::make_shared<DemoTransportCtlConfig>();
+        if (!ApplyOptions(options, *config))
+        {
+            return nullptr;
+        }
+        return DemoTransportCtlFactory().MakeTransportController(config);
+    }
+    if (options.ctl == "cubic")
+    {
+        auto config = std::make_shared<CubicTransportCtlConfig>();
+        if (!ApplyOptions(options, *config))
+        {
+            return nullptr;
+        }
+        return CubicTransportCtlFactory().MakeTransportController(config);
+    }
+    return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+    SimOptions options;
+    SimTopology topo;
+    if (!ParseOptions(argc, argv, options) || !simscenarios::MakeTopology(options.topo, options.seed, topo))
+    {
+        Usage();
+        return 1;
+    }
+    if (options.outageS > 0)
+    {
+        for (auto&& link: topo.serverLinks)
+        {
+            for (auto&& outage: link.outages)
+            {
+                outage.second = outage.first + Duration::FromSeconds(options.outageS);
+            }
+        }
+    }
+    for (auto&& link: topo.serverLinks)
+    {
+        link.jitter = Duration::FromMilliseconds(options.jitterMs);
+    }
+    spdlog::set_level(spdlog::level::off);
+
+    auto wallStart = std::chrono::steady_clock::now();
+    SimEventLoop loop;
+    Timepoint startTic = loop.Now();
+    SimNetwork network(loop, topo, options.seed);
+    network.StartCrossTraffic();
+
+    std::vector<std::shared_ptr<SimDownloader>> downloaders;
+    std::vector<std::shared_ptr<MPDTransportController>> controllers;
+    for (size_t client = 0; client < network.ClientCount(); ++client)
+    {
+        auto controller = MakeController(options);
+        if (!controller)
+        {
+            Usage();
+            return 1;
+        }
+        auto downloader = std::make_shared<SimDownloader>(loop, network, client, options.size,
+                Duration::FromMilliseconds(options.alarmMs));
+        downloader->Start(controller);
+        if (options.destroyS > 0)
+        {
+            loop.ScheduleIn(Duration::FromSeconds(options.destroyS), [downloader, &network]() {
+                downloader->DestroySession(network.ServerCount() - 1);
+            });
+        }
+        controllers.push_back(controller);
+        downloaders.push_back(downloader);
+    }
+
+    // cross traffic keeps the loop busy, so stop as soon as every client is done
+    Timepoint until = startTic + Duration::FromSeconds(options.untilS);
+    Duration step = Duration::FromMilliseconds(options.alarmMs);
+    for (Timepoint now = startTic; now < until;)
+    {
+        now = now + step;
+        loop.Run(now);
+        bool allFinished = true;
+        for (auto&& downloader: downloaders)
+        {
+            allFinished = allFinished && downloader->Finished();
+        }
+        if (allFinished)
+        {
+            break;
+        }
+    }
+    auto wallUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wallStart).count();
+
+    std::cout << "topo: " << topo.name << " ctl: " << options.ctl
+              << " cc: " << (options.cc.empty() ? "default" : options.cc) << " sched: " << options.sched
+              << " lossdetect: " << options.lossdetect << " pacing: " << options.pacing
+              << " endgame: " << options.endgame << " oppretrans: " << options.oppRetrans
+              << " health: " << options.health << " undo: " << options.spuriousLossUndo
+              << " hystart: " << options.hystart << " prr: " << options.prr << " lossdiff: " << options.lossDiff
+              << " seed: " << options.seed << std::endl;
+    int ret = 0;
+    for (size_t client = 0; client < downloaders.size(); ++client)
+    {
+        auto&& stats = downloaders[client]->GetStats();
+        std::cout << "client " << client << ": ";
+        if (stats.finished)
+        {
+            double seconds = stats.downloadTime.ToMicroseconds() / 1000000.0;
+            std::cout << "finished in " << seconds << " s, " << options.size * 8 / seconds / 1000000 << " Mbps";
+        }
+        else
+        {
+            std::cout << "unfinished";
+            ret = 2;
+        }
+        std::cout << ", requests: " << stats.requestPkts << ", requested pieces: " << stats.requestedPieces
+                  << ", received pieces: " << stats.receivedPieces << ", duplicates: " << stats.duplicatePieces
+                  << std::endl;
+        for (size_t server = 0; server < stats.serverPieces.size(); ++server)
+        {
+            std::cout << "  server " << server << ": pieces: " << stats.serverPieces[server]
+                      << ", longest gap: " << stats.serverMaxGap[server].ToMicroseconds() / 1000000.0 << " s"
+                      << std::endl;
+        }
+    }
+    std::cout << network.DebugInfo() << std::endl;
+    std::cout << "events: " << loop.HandledEvents() << ", wall time: " << wallUs / 1000 << " ms" << std::endl;
+
+    for (auto&& controller: controllers)
+    {
+        controller->StopTransportController();
+    }
+    return ret;
+}
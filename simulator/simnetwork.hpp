@@ -0,0 +1,161 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "simeventloop.hpp"
+#include "simlink.hpp"
+
+/// constant bit rate traffic crossing a bottleneck toward the clients
+struct SimCrossTraffic
+{
+    size_t bottleneck{ 0 };
+    double rateMbps{ 1 };
+    Duration start{ Duration::Zero() };
+    Duration end{ Duration::Infinite() };
+    uint32_t pktSize{ 1500 };
+};
+
+/// client --- left switch === bottleneck === right switch --- servers, as in the mininet/topo-*.py scripts.
+/// Each link config is used for both directions, like loss1 and loss2 which are always equal in the scripts.
+struct SimTopology
+{
+    std::string name;
+    uint32_t clientCount{ 1 };
+    SimLinkConfig clientLink;/** each client has its own access link*/
+    std::vector<SimLinkConfig> bottlenecks;
+    std::vector<SimLinkConfig> serverLinks;
+    std::vector<size_t> serverBottleneck;/** the bottleneck each server sits behind*/
+    std::vector<SimCrossTraffic> crossTraffic;
+};
+
+/// SimNetwork forwards packets hop by hop between the clients and the servers
+class SimNetwork
+{
+public:
+    SimNetwork(SimEventLoop& loop, const SimTopology& topo, uint64_t seed)
+            : m_loop(loop), m_topo(topo)
+    {
+        Timepoint startTime = m_loop.Now();
+        auto newLinkPair = [&](const SimLinkConfig& config, std::vector<SimLink*>& up, std::vector<SimLink*>& down) {
+            m_links.emplace_back(new SimLink(config, startTime, seed + m_links.size()));
+            up.push_back(m_links.back().get());
+            m_links.emplace_back(new SimLink(config, startTime, seed + m_links.size()));
+            down.push_back(m_links.back().get());
+        };
+
+        std::vector<SimLink*> clientUp, clientDown, bottleneckUp, bottleneckDown, serverUp, serverDown;
+        for (uint32_t client = 0; client < m_topo.clientCount; ++client)
+        {
+            newLinkPair(m_topo.clientLink, clientUp, clientDown);
+        }
+        for (auto&& config: m_topo.bottlenecks)
+        {
+            newLinkPair(config, bottleneckUp, bottleneckDown);
+        }
+        for (auto&& config: m_topo.serverLinks)
+        {
+            newLinkPair(config, serverUp, serverDown);
+        }
+        m_bottleneckDown = bottleneckDown;
+
+        m_upPaths.resize(m_topo.clientCount);
+        m_downPaths.resize(m_topo.clientCount);
+        for (uint32_t client = 0; client < m_topo.clientCount; ++client)
+        {
+            for (size_t server = 0; server < m_topo.serverLinks.size(); ++server)
+            {
+                size_t bottleneck = m_topo.serverBottleneck.at(server);
+                m_upPaths[client].push_back({ clientUp[client], bottleneckUp.at(bottleneck), serverUp[server] });
+                m_downPaths[client].push_back({ serverDown[server], bottleneckDown.at(bottleneck), clientDown[client] });
+            }
+        }
+    }
+
+    size_t ServerCount() const
+    {
+        return m_topo.serverLinks.size();
+    }
+
+    size_t ClientCount() const
+    {
+        return m_topo.clientCount;
+    }
+
+    /// onArrive is called when the packet reaches the server, never if it's dropped
+    void SendToServer(size_t client, size_t server, uint32_t bytes, SimEventLoop::Handler onArrive)
+    {
+        Forward(&m_upPaths[client][server], 0, bytes, std::move(onArrive));
+    }
+
+    /// onArrive is called when the packet reaches the client, never if it's dropped
+    void SendToClient(size_t client, size_t server, uint32_t bytes, SimEventLoop::Handler onArrive)
+    {
+        Forward(&m_downPaths[client][server], 0, bytes, std::move(onArrive));
+    }
+
+    void StartCrossTraffic()
+    {
+        for (auto&& cross: m_topo.crossTraffic)
+        {
+            Duration interval = Duration::FromMicroseconds(static_cast<int64_t>(cross.pktSize * 8 / cross.rateMbps));
+            Timepoint end = cross.end.IsInfinite() ? Timepoint::Infinite() : m_loop.Now() + cross.end;
+            SendCrossTraffic(cross, interval, m_loop.Now() + cross.start, end);
+        }
+    }
+
+    std::string DebugInfo() const
+    {
+        std::stringstream ss;
+        uint64_t sent = 0, dropped = 0, queueDropped = 0;
+        for (auto&& link: m_links)
+        {
+            sent += link->SentPkts();
+            dropped += link->DroppedPkts();
+            queueDropped += link->QueueDrops();
+        }
+        ss << "hops sent: " << sent << " dropped: " << dropped << " (queue full: " << queueDropped << ")";
+        return ss.str();
+    }
+
+private:
+    void Forward(const std::vector<SimLink*>* path, size_t hop, uint32_t bytes, SimEventLoop::Handler onArrive)
+    {
+        if (hop == path->size())
+        {
+            onArrive();
+            return;
+        }
+        Timepoint arrival{ Timepoint::Zero() };
+        if (!(*path)[hop]->Transmit(bytes, m_loop.Now(), arrival))
+        {
+            return;
+        }
+        m_loop.Schedule(arrival, [this, path, hop, bytes, onArrive]() {
+            Forward(path, hop + 1, bytes, onArrive);
+        });
+    }
+
+    void SendCrossTraffic(const SimCrossTraffic& cross, Duration interval, Timepoint at, Timepoint end)
+    {
+        if (at >= end)
+        {
+            return;
+        }
+        m_loop.Schedule(at, [this, &cross, interval, at, end]() {
+            Timepoint arrival{ Timepoint::Zero() };
+            m_bottleneckDown.at(cross.bottleneck)->Transmit(cross.pktSize, m_loop.Now(), arrival);
+            SendCrossTraffic(cross, interval, at + interval, end);
+        });
+    }
+
+    SimEventLoop& m_loop;
+    SimTopology m_topo;
+    std::vector<std::unique_ptr<SimLink>> m_links;
+    std::vector<SimLink*> m_bottleneckDown;
+    std::vector<std::vector<std::vector<SimLink*>>> m_upPaths;/** [client][server], client to server hops*/
+    std::vector<std::vector<std::vector<SimLink*>>> m_downPaths;/** [client][server], server to client hops*/
+};
@@ -0,0 +1,100 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include "simnetwork.hpp"
+
+namespace simscenarios
+{
+    inline SimLinkConfig MakeLink(double bwMbps, int64_t delayMs, uint32_t maxQueueSize, double lossPercent)
+    {
+        SimLinkConfig config;
+        config.bwMbps = bwMbps;
+        config.delay = Duration::FromMilliseconds(delayMs);
+        config.maxQueueSize = maxQueueSize;
+        config.lossPercent = lossPercent;
+        return config;
+    }
+
+    /// server links only set the delay in the topo scripts
+    inline void AddServers(SimTopology& topo, size_t bottleneck, std::initializer_list<int64_t> delaysMs)
+    {
+        for (auto delayMs: delaysMs)
+        {
+            topo.serverLinks.push_back(MakeLink(0, delayMs, 1000, 0));
+            topo.serverBottleneck.push_back(bottleneck);
+        }
+    }
+
+    /// the iperf TCP flow of the topo scripts, started at 10s for 20s, taken as half of the bottleneck
+    inline void AddTcpFlow(SimTopology& topo, size_t bottleneck)
+    {
+        SimCrossTraffic cross;
+        cross.bottleneck = bottleneck;
+        cross.rateMbps = topo.bottlenecks.at(bottleneck).bwMbps / 2;
+        cross.start = Duration::FromSeconds(10);
+        cross.end = Duration::FromSeconds(30);
+        topo.crossTraffic.push_back(cross);
+    }
+
+    /**
+     * @brief build the topology of mininet/topo-<n>.py
+     * @param name topo-1 ... topo-5
+     * @param seed picks the server link to be cut in topo-5
+     * @return false if name is unknown
+     */
+    inline bool MakeTopology(const std::string& name, uint64_t seed, SimTopology& topo)
+    {
+        topo = SimTopology();
+        topo.name = name;
+        if (name == "topo-1")
+        {
+            // single bottleneck with a short queue, five servers
+            topo.clientLink = MakeLink(500, 10, 100, 0);
+            topo.bottlenecks.push_back(MakeLink(2, 15, 10, 1));
+            AddServers(topo, 0, { 5, 15, 25, 35, 45 });
+        }
+        else if (name == "topo-2")
+        {
+            // shared bottleneck with a TCP flow
+            topo.clientLink = MakeLink(1000, 10, 1000, 0);
+            topo.bottlenecks.push_back(MakeLink(1.5, 30, 20, 1));
+            AddServers(topo, 0, { 5, 10, 15, 20 });
+            AddTcpFlow(topo, 0);
+        }
+        else if (name == "topo-3")
+        {
+            // two bottlenecks, the TCP flow shares the slower one
+            topo.clientLink = MakeLink(1000, 10, 1000, 0);
+            topo.bottlenecks.push_back(MakeLink(3.5, 30, 20, 1));
+            topo.bottlenecks.push_back(MakeLink(1.5, 30, 20, 1));
+            AddServers(topo, 0, { 5, 10 });
+            AddServers(topo, 1, { 15, 20 });
+            AddTcpFlow(topo, 1);
+        }
+        else if (name == "topo-4")
+        {
+            // two clients sharing one bottleneck
+            topo.clientCount = 2;
+            topo.clientLink = MakeLink(1000, 10, 200, 0);
+            topo.bottlenecks.push_back(MakeLink(10, 30, 100, 1));
+            AddServers(topo, 0, { 5, 10, 15, 20 });
+        }
+        else if (name == "topo-5")
+        {
+            // one of the server links goes down at 10s
+            topo.clientLink = MakeLink(1000, 10, 1000, 0);
+            topo.bottlenecks.push_back(MakeLink(1.5, 30, 100, 1));
+            AddServers(topo, 0, { 5, 10, 15, 20 });
+            topo.serverLinks[seed % topo.serverLinks.size()].outages.emplace_back(Duration::FromSeconds(10),
+                    Duration::Infinite());
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,255 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+/// mpdunittest checks the data structures of the demo controllers and the trace scorer, which need no network.
+/// usage: mpdunittest, the exit code is the number of failed checks.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include "demo/utils/piecewindow.hpp"
+#include "demo/utils/piecetable.hpp"
+#include "demo/utils/receivebitmap.hpp"
+#include "tools/tracescore.hpp"
+
+static int g_failures = 0;
+
+#define CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++g_failures; \
+        } \
+    } while (0)
+
+static void TestPieceWindow()
+{
+    PieceWindow window;
+    CHECK(window.empty());
+    CHECK(window.Lowest() == MAX_DATANUMBER);
+    CHECK(window.NextFrom(0) == MAX_DATANUMBER);
+
+    // across the boundary of the first and second word
+    window.InsertRange(60, 70);
+    CHECK(window.size() == 10);
+    CHECK(!window.Insert(63));
+    CHECK(window.Contains(63) && window.Contains(64) && !window.Contains(70));
+    CHECK(window.Erase(64));
+    CHECK(!window.Erase(64));
+    CHECK(window.NextFrom(64) == 65);
+    CHECK(window.NextFrom(-5) == 60);
+    CHECK(window.NextFrom(70) == MAX_DATANUMBER);
+
+    // slide forward by several words, then back below the base word
+    window.Insert(1000);
+    for (DataNumber pno: { 60, 61, 62, 63, 65, 66, 67, 68, 69, 1000 })
+    {
+        CHECK(window.PopLowest() == pno);
+    }
+    CHECK(window.empty());
+    window.Insert(5000);
+    window.Insert(5);
+    CHECK(window.Lowest() == 5);
+    CHECK(window.NextFrom(-1) == 5);
+    CHECK(window.NextFrom(6) == 5000);
+    CHECK(!window.Insert(-1));
+    CHECK(!window.Contains(-1));
+
+    std::vector<DataNumber> pieces(window.begin(), window.end());
+    CHECK((pieces == std::vector<DataNumber>{ 5, 5000 }));
+
+    PieceWindow other;
+    other.InsertRange(126, 130);
+    window.Insert(other);
+    CHECK(window.size() == 6);
+    CHECK(window.NextFrom(100) == 126);
+
+    window.clear();
+    CHECK(window.empty());
+    CHECK(window.NextFrom(0) == MAX_DATANUMBER);
+}
+
+static void TestInFlightPacketMap()
+{
+    InFlightPacketMap map;
+    // no packet sent or acked yet
+    CHECK(map.MaxSeqInflightPkt().seq == MAX_SEQNUMBER);
+    CHECK(map.MaxSeqAckedPkt().seq == MAX_SEQNUMBER);
+    CHECK(map.OldestInFlight() == nullptr);
+
+    Timepoint sendtic{ Timepoint::Zero() };
+    DataPacket pkt;
+    for (SeqNumber seq = 0; seq < 200; ++seq)
+    {
+        pkt.seq = seq;
+        pkt.pieceId = static_cast<DataNumber>(seq);
+        map.AddSentPacket(pkt, sendtic);
+    }
+    for (SeqNumber seq = 0; seq < 150; ++seq)
+    {
+        InflightPacket inflight = map.PktIsInFlight(seq).second;
+        map.OnPacktReceived(inflight, sendtic);
+    }
+    CHECK(map.MaxSeqAckedPkt().seq == 149);
+
+    // the ring of 256 slots wraps around
+    for (SeqNumber seq = 200; seq < 400; ++seq)
+    {
+        pkt.seq = seq;
+        pkt.pieceId = static_cast<DataNumber>(seq);
+        map.AddSentPacket(pkt, sendtic);
+    }
+    CHECK(map.InFlightPktNum() == 250);
+    CHECK(map.OldestInFlight() && map.OldestInFlight()->seq == 150);
+    CHECK(map.MaxSeqInflightPkt().seq == 399);
+    CHECK(!map.PktIsInFlight(149).first);
+    CHECK(map.PktIsInFlight(399).first && map.PktIsInFlight(399).second.pieceId == 399);
+
+    // 350 packets in flight don't fit in the ring, it grows
+    for (SeqNumber seq = 400; seq < 500; ++seq)
+    {
+        pkt.seq = seq;
+        pkt.pieceId = static_cast<DataNumber>(seq);
+        map.AddSentPacket(pkt, sendtic);
+    }
+    CHECK(map.InFlightPktNum() == 350);
+    InflightPacket lost = map.PktIsInFlight(300).second;
+    map.RemoveFromInFlight(lost);
+    SeqNumber expected = 150;
+    bool ordered = true;
+    map.ForEachFromOldest([&expected, &ordered](const InflightEntry& entry) {
+        ordered = ordered && entry.seq == expected;
+        expected = expected == 299 ? 301 : expected + 1;
+        return true;
+    });
+    CHECK(ordered && expected == 500);
+    CHECK(map.InFlightPktNum() == 349);
+}
+
+static void TestPieceTable()
+{
+    fw::ID sessionid;
+    Timepoint now{ Timepoint::Zero() };
+    PieceTable table;
+    CHECK(table.State(-1) == PieceState::absent);
+    CHECK(table.State(0) == PieceState::absent);
+    CHECK(table.AllocatedPages() == 0);
+
+    const DataNumber pagePieces = 1 << 16;
+    for (DataNumber pno = 0; pno < pagePieces + 10; ++pno)
+    {
+        table.OnAdded(pno);
+    }
+    CHECK(!table.OnAdded(0));
+    CHECK(table.AllocatedPages() == 2);
+    CHECK(table.Count(PieceState::pending) == static_cast<size_t>(pagePieces) + 10);
+
+    table.OnRequested(7, sessionid, now);
+    table.OnRequested(7, sessionid, now);
+    CHECK(table.State(7) == PieceState::inflight);
+    CHECK(table.Record(7) && table.Record(7)->attempts == 2 && table.Record(7)->sessions.size() == 1);
+    table.OnRequeued(7);
+    CHECK(table.State(7) == PieceState::pending);
+
+    // the first page is freed once all its pieces have been received
+    for (DataNumber pno = 0; pno < pagePieces; ++pno)
+    {
+        table.OnReceived(pno);
+    }
+    CHECK(table.AllocatedPages() == 1);
+    CHECK(table.Record(7) == nullptr);
+    CHECK(table.State(7) == PieceState::received);
+    CHECK(!table.OnReceived(7));
+    CHECK(table.Count(PieceState::received) == static_cast<size_t>(pagePieces));
+    CHECK(table.Count(PieceState::pending) == 10);
+
+    table.clear();
+    CHECK(table.AllocatedPages() == 0);
+    CHECK(table.State(7) == PieceState::absent);
+}
+
+static void TestReceiveBitmap()
+{
+    ReceiveBitmap bitmap;
+    CHECK(bitmap.ContiguousEnd() == 0);
+    CHECK(bitmap.NextReceived() == MAX_DATANUMBER);
+
+    for (DataNumber pno: { 1, 2, 3 })
+    {
+        CHECK(bitmap.Insert(pno));
+    }
+    CHECK(!bitmap.Insert(2));
+    CHECK(bitmap.ContiguousEnd() == 0);
+    CHECK(bitmap.NextReceived() == 1);
+    CHECK(bitmap.AheadCount() == 3);
+
+    CHECK(bitmap.Insert(0));
+    CHECK(bitmap.ContiguousEnd() == 4);
+    CHECK(bitmap.AheadCount() == 0);
+    CHECK(!bitmap.Insert(0));
+
+    // several words ahead of the prefix
+    CHECK(bitmap.Insert(200));
+    CHECK(bitmap.NextReceived() == 200);
+    CHECK(bitmap.Contains(200) && !bitmap.Contains(199) && !bitmap.Contains(-1));
+    for (DataNumber pno = 4; pno < 200; ++pno)
+    {
+        bitmap.Insert(pno);
+    }
+    CHECK(bitmap.ContiguousEnd() == 201);
+    CHECK(bitmap.AheadCount() == 0);
+    CHECK(bitmap.Contains(100));
+
+    bitmap.clear();
+    CHECK(bitmap.ContiguousEnd() == 0);
+    CHECK(!bitmap.Contains(100));
+}
+
+/// the reference values are printed by get_score.py for the same trace
+static void TestTraceScorer()
+{
+    const char* path = "mpdunittest_trace.log";
+    {
+        std::ofstream trace(path);
+        for (int64_t i = 0; i < 10240; ++i)
+        {
+            trace << "[trace] {\"event\":\"Tx\",\"timestamp\":" << 1000 + 50 * i << ",\"value\":" << i << "}\n";
+        }
+        // 10 ms a piece for the first 2000 pieces, 5 ms after, reordered by up to 80 ms
+        for (int64_t i = 0; i < 10240; ++i)
+        {
+            int64_t rx = (i < 2000 ? 5000 + 10000 * i : 5000 + 10000 * 2000 + 5000 * (i - 2000)) + 20000 * (i % 5);
+            trace << "[trace] {\"event\":\"Rx\",\"timestamp\":" << rx << ",\"value\":" << i << "}\n";
+            if (i % 97 == 0)
+            {
+                trace << "[trace] {\"event\":\"Rx\",\"timestamp\":" << rx + 30000 << ",\"value\":" << i << "}\n";
+            }
+        }
+    }
+
+    ScoreResult result;
+    CHECK(ScoreTraceFile(path, ScoreConfig(), result));
+    remove(path);
+    CHECK(result.status == "ok");
+    CHECK(result.uniquePieces == 10240);
+    CHECK(result.rxRecords == 10346);
+    CHECK(std::fabs(result.score - 152.0434550546) < 1e-10);
+    CHECK(std::fabs(result.alpha - 1.00517578125) < 1e-10);
+    CHECK(std::fabs(result.beta - 0.0938820803211541) < 1e-10);
+}
+
+int main()
+{
+    TestPieceWindow();
+    TestInFlightPacketMap();
+    TestPieceTable();
+    TestReceiveBitmap();
+    TestTraceScorer();
+    if (g_failures == 0)
+    {
+        printf("all checks passed\n");
+    }
+    return g_failures;
+}
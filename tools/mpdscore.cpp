@@ -0,0 +1,150 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+/// mpdscore computes the score of get_score.py for any number of trace logs, in parallel.
+/// usage: mpdscore [-j threads] [--filesize KB] [--bitrate bps] trace.log [trace.log ...]
+/// A JSON array with one summary per trace, in the order given, is printed to stdout.
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tracescore.hpp"
+
+static void Usage()
+{
+    std::cerr << "usage: mpdscore [-j threads] [--filesize KB] [--bitrate bps] trace.log [trace.log ...]" << std::endl;
+}
+
+static std::string JsonString(const std::string& str)
+{
+    std::string out = "\"";
+    for (char ch: str)
+    {
+        if (ch == '"' || ch == '\\')
+        {
+            out += '\\';
+            out += ch;
+        }
+        else if (static_cast<unsigned char>(ch) < 0x20)
+        {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            out += buf;
+        }
+        else
+        {
+            out += ch;
+        }
+    }
+    return out + "\"";
+}
+
+/// the shortest form which reads back to the same double, like python prints it
+static std::string JsonNumber(double number)
+{
+    char buf[64];
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, number);
+        if (strtod(buf, nullptr) == number)
+        {
+            break;
+        }
+    }
+    return buf;
+}
+
+static std::string ToJson(const std::string& path, const ScoreResult& result)
+{
+    std::stringstream ss;
+    ss << "{\"trace\":" << JsonString(path)
+       << ",\"status\":" << JsonString(result.status)
+       << ",\"score\":" << JsonNumber(result.score)
+       << ",\"alpha\":" << JsonNumber(result.alpha)
+       << ",\"beta\":" << JsonNumber(result.beta)
+       << ",\"downloadTime\":" << JsonNumber(result.downloadTime)
+       << ",\"stallTime\":" << JsonNumber(result.stallTime)
+       << ",\"startTs\":" << JsonNumber(result.startTs)
+       << ",\"endTs\":" << JsonNumber(result.endTs)
+       << ",\"txRecords\":" << result.txRecords
+       << ",\"rxRecords\":" << result.rxRecords
+       << ",\"uniquePieces\":" << result.uniquePieces
+       << ",\"duplicatePieces\":" << result.rxRecords - result.uniquePieces
+       << ",\"malformedLines\":" << result.malformedLines
+       << "}";
+    return ss.str();
+}
+
+int main(int argc, char* argv[])
+{
+    ScoreConfig config;
+    uint32_t threadCnt = std::max(std::thread::hardware_concurrency(), 1U);
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-j" && hasValue)
+        {
+            threadCnt = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--filesize" && hasValue)
+        {
+            config.fileSizeKB = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--bitrate" && hasValue)
+        {
+            config.bitrate = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            Usage();
+            return 1;
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty() || threadCnt == 0 || config.fileSizeKB == 0 || config.bitrate == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    // each thread takes the next trace until all are scored
+    std::vector<ScoreResult> results(paths.size());
+    std::vector<char> readable(paths.size(), 0);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t idx = next++; idx < paths.size(); idx = next++)
+        {
+            ScoreResult result;
+            bool ok = ScoreTraceFile(paths[idx], config, result);
+            results[idx] = result;
+            readable[idx] = ok;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < std::min<size_t>(threadCnt, paths.size()); ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    for (auto&& thread: threads)
+    {
+        thread.join();
+    }
+
+    int ret = 0;
+    std::cout << "[" << std::endl;
+    for (size_t idx = 0; idx < paths.size(); ++idx)
+    {
+        std::cout << "  " << ToJson(paths[idx], results[idx]) << (idx + 1 < paths.size() ? "," : "") << std::endl;
+        ret = readable[idx] ? ret : 2;
+    }
+    std::cout << "]" << std::endl;
+    return ret;
+}
@@ -0,0 +1,551 @@
+// Copyright (c) 2023. ByteDance Inc. All rights reserved.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// fields of one trace record, the event points into the trace
+struct TraceRecord
+{
+    const char* event{ nullptr };
+    size_t eventLen{ 0 };
+    bool hasTimestamp{ false };
+    double timestamp{ 0 };
+    bool hasValue{ false };
+    int64_t value{ 0 };
+
+    bool IsEvent(const char* name) const
+    {
+        size_t len = strlen(name);
+        return event && eventLen == len && memcmp(event, name, len) == 0;
+    }
+};
+
+/// Parser of the flat JSON object each trace line carries, e.g. {"event":"Rx","timestamp":1234,"value":5}.
+/// It walks the bytes in place and never allocates.
+class TraceRecordParser
+{
+public:
+    /// @param begin points to '{', end points past the matching '}'
+    /// @return false if [begin, end) is not a valid JSON object
+    static bool Parse(const char* begin, const char* end, TraceRecord& record)
+    {
+        record = TraceRecord();
+        const char* p = begin;
+        if (p == end || *p++ != '{')
+        {
+            return false;
+        }
+        SkipWs(p, end);
+        if (p != end && *p == '}')
+        {
+            return p + 1 == end;
+        }
+        while (p != end)
+        {
+            const char* key = nullptr;
+            size_t keyLen = 0;
+            if (!ParseString(p, end, key, keyLen))
+            {
+                return false;
+            }
+            SkipWs(p, end);
+            if (p == end || *p++ != ':')
+            {
+                return false;
+            }
+            SkipWs(p, end);
+            if (!ParseValue(p, end, key, keyLen, record))
+            {
+                return false;
+            }
+            SkipWs(p, end);
+            if (p == end)
+            {
+                return false;
+            }
+            if (*p == '}')
+            {
+                return p + 1 == end;
+            }
+            if (*p++ != ',')
+            {
+                return false;
+            }
+            SkipWs(p, end);
+        }
+        return false;
+    }
+
+private:
+    static void SkipWs(const char*& p, const char* end)
+    {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        {
+            ++p;
+        }
+    }
+
+    static bool KeyIs(const char* key, size_t keyLen, const char* name)
+    {
+        return keyLen == strlen(name) && memcmp(key, name, keyLen) == 0;
+    }
+
+    /// @param str, len the raw content between the quotes, escapes are kept as they are
+    static bool ParseString(const char*& p, const char* end, const char*& str, size_t& len)
+    {
+        if (p == end || *p != '"')
+        {
+            return false;
+        }
+        str = ++p;
+        while (p != end && *p != '"')
+        {
+            if (static_cast<unsigned char>(*p) < 0x20)
+            {
+                return false;
+            }
+            if (*p == '\\' && ++p == end)
+            {
+                return false;
+            }
+            ++p;
+        }
+        if (p == end)
+        {
+            return false;
+        }
+        len = p - str;
+        ++p;
+        return true;
+    }
+
+    static bool ParseNumber(const char*& p, const char* end, double& number, bool& integral)
+    {
+        const char* start = p;
+        if (p != end && *p == '-')
+        {
+            ++p;
+        }
+        if (p == end || !IsDigit(*p) || (*p == '0' && p + 1 != end && IsDigit(p[1])))
+        {
+            return false;
+        }
+        int64_t intPart = 0;
+        bool overflow = false;
+        while (p != end && IsDigit(*p))
+        {
+            overflow = overflow || intPart > (std::numeric_limits<int64_t>::max() - 9) / 10;
+            intPart = intPart * 10 + (*p++ - '0');
+        }
+        integral = !overflow;
+        if (p != end && *p == '.')
+        {
+            integral = false;
+            if (++p == end || !IsDigit(*p))
+            {
+                return false;
+            }
+            while (p != end && IsDigit(*p))
+            {
+                ++p;
+            }
+        }
+        if (p != end && (*p == 'e' || *p == 'E'))
+        {
+            integral = false;
+            if (++p != end && (*p == '+' || *p == '-'))
+            {
+                ++p;
+            }
+            if (p == end || !IsDigit(*p))
+            {
+                return false;
+            }
+            while (p != end && IsDigit(*p))
+            {
+                ++p;
+            }
+        }
+        if (integral)
+        {
+            number = static_cast<double>(*start == '-' ? -intPart : intPart);
+            return true;
+        }
+        // rare, copy to a terminated buffer for strtod
+        char buf[64];
+        size_t len = p - start;
+        if (len >= sizeof(buf))
+        {
+            return false;
+        }
+        memcpy(buf, start, len);
+        buf[len] = '\0';
+        number = strtod(buf, nullptr);
+        integral = std::floor(number) == number && std::fabs(number) < 9007199254740992.0;
+        return true;
+    }
+
+    static bool ParseLiteral(const char*& p, const char* end, const char* literal)
+    {
+        size_t len = strlen(literal);
+        if (static_cast<size_t>(end - p) < len || memcmp(p, literal, len) != 0)
+        {
+            return false;
+        }
+        p += len;
+        return true;
+    }
+
+    /// arrays of scalars are skipped, nested objects can't be there since the record ends at the first '}'
+    static bool SkipArray(const char*& p, const char* end)
+    {
+        int depth = 0;
+        while (p != end)
+        {
+            if (*p == '"')
+            {
+                const char* str = nullptr;
+                size_t len = 0;
+                if (!ParseString(p, end, str, len))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (*p == '[')
+            {
+                ++depth;
+            }
+            else if (*p == ']' && --depth == 0)
+            {
+                ++p;
+                return true;
+            }
+            ++p;
+        }
+        return false;
+    }
+
+    static bool ParseValue(const char*& p, const char* end, const char* key, size_t keyLen, TraceRecord& record)
+    {
+        if (p == end)
+        {
+            return false;
+        }
+        if (*p == '"')
+        {
+            const char* str = nullptr;
+            size_t len = 0;
+            if (!ParseString(p, end, str, len))
+            {
+                return false;
+            }
+            if (KeyIs(key, keyLen, "event"))
+            {
+                record.event = str;
+                record.eventLen = len;
+            }
+            return true;
+        }
+        if (*p == '-' || IsDigit(*p))
+        {
+            double number = 0;
+            bool integral = false;
+            if (!ParseNumber(p, end, number, integral))
+            {
+                return false;
+            }
+            if (KeyIs(key, keyLen, "timestamp"))
+            {
+                record.hasTimestamp = true;
+                record.timestamp = number;
+            }
+            else if (KeyIs(key, keyLen, "value") && integral)
+            {
+                record.hasValue = true;
+                record.value = static_cast<int64_t>(number);
+            }
+            return true;
+        }
+        if (*p == '[')
+        {
+            return SkipArray(p, end);
+        }
+        return ParseLiteral(p, end, "true") || ParseLiteral(p, end, "false") || ParseLiteral(p, end, "null");
+    }
+
+    static bool IsDigit(char ch)
+    {
+        return ch >= '0' && ch <= '9';
+    }
+};
+
+/// parameters of the score, the same as get_score.py
+struct ScoreConfig
+{
+    uint64_t fileSizeKB{ 10 * 1024 };
+    uint64_t bitrate{ 1 * 1024 * 1024 };/** bps*/
+    uint32_t checkIntervalS{ 10 };/** check the playback every so many seconds*/
+};
+
+struct ScoreResult
+{
+    std::string status{ "ok" };/** ok, or why the score is 0*/
+    double score{ 0 };/** KBps, rounded to 10 decimals*/
+    double alpha{ 0 };/** duplicate download factor*/
+    double beta{ 0 };/** stall time / download time*/
+    double startTs{ 0 };/** us, timestamp of the first requested piece*/
+    double endTs{ 0 };/** us, when the last piece is received*/
+    double downloadTime{ 0 };/** s*/
+    double stallTime{ 0 };/** s, summed over the checkpoints*/
+    uint64_t txRecords{ 0 };
+    uint64_t rxRecords{ 0 };/** duplicates included*/
+    uint64_t uniquePieces{ 0 };
+    uint64_t malformedLines{ 0 };/** lines with a '{...}' that's not a valid record, skipped*/
+};
+
+/// Computes the score of get_score.py while the trace records are streamed in.
+/// Only the first Tx of the lowest piece and the first Rx of each piece are kept, so memory is bounded by the
+/// number of pieces instead of the size of the trace.
+class TraceScorer
+{
+public:
+    explicit TraceScorer(const ScoreConfig& config) : m_config(config)
+    {
+    }
+
+    void Add(const TraceRecord& record)
+    {
+        if (!record.hasTimestamp || !record.hasValue)
+        {
+            return;
+        }
+        if (record.IsEvent("Tx"))
+        {
+            ++m_result.txRecords;
+            // get_score.py takes the first row after sorting Tx by piece, the earliest one is taken among equals
+            if (m_result.txRecords == 1 || record.value < m_lowestTxPiece ||
+                (record.value == m_lowestTxPiece && record.timestamp < m_result.startTs))
+            {
+                m_lowestTxPiece = record.value;
+                m_result.startTs = record.timestamp;
+            }
+        }
+        else if (record.IsEvent("Rx"))
+        {
+            ++m_result.rxRecords;
+            double& firstRecv = FirstRecv(record.value);
+            firstRecv = std::min(firstRecv, record.timestamp);
+        }
+    }
+
+    void AddMalformedLine()
+    {
+        ++m_result.malformedLines;
+    }
+
+    ScoreResult Finish()
+    {
+        const double fs = static_cast<double>(m_config.fileSizeKB);
+        const double dt = fs * 1024 * 8 / m_config.bitrate;
+        if (m_result.rxRecords == 0)
+        {
+            return Fail("data loss");
+        }
+        if (m_result.txRecords == 0)
+        {
+            return Fail("no Tx record");
+        }
+
+        // the receive time of a piece becomes the time all the pieces up to it are received
+        std::vector<std::pair<int64_t, double>> recvTs;
+        for (auto&& itor: m_sparseRecv)
+        {
+            if (itor.first < 0)
+            {
+                recvTs.emplace_back(itor.first, itor.second);
+            }
+        }
+        for (size_t piece = 0; piece < m_denseRecv.size(); ++piece)
+        {
+            if (m_denseRecv[piece] != kNotReceived)
+            {
+                recvTs.emplace_back(piece, m_denseRecv[piece]);
+            }
+        }
+        for (auto&& itor: m_sparseRecv)
+        {
+            if (itor.first >= 0)
+            {
+                recvTs.emplace_back(itor.first, itor.second);
+            }
+        }
+        double tsTmp = 0;
+        for (auto&& pieceTs: recvTs)
+        {
+            tsTmp = std::max(pieceTs.second, tsTmp);
+            pieceTs.second = tsTmp;
+        }
+
+        m_result.uniquePieces = recvTs.size();
+        m_result.endTs = recvTs.back().second;
+        m_result.downloadTime = (m_result.endTs - m_result.startTs) / 1e6;
+        double t = m_result.downloadTime;
+        double ds = m_result.rxRecords / 1024.0;
+        if (m_result.uniquePieces < m_config.fileSizeKB)
+        {
+            return Fail("not recv enough data");
+        }
+        if (t > dt)
+        {
+            return Fail("timeout");
+        }
+        if (t <= 0)
+        {
+            return Fail("invalid download duration");
+        }
+
+        double tSum = 0;
+        for (uint64_t i = 0; i < static_cast<uint64_t>(std::floor(dt / m_config.checkIntervalS)); ++i)
+        {
+            double playedS = static_cast<double>(m_config.checkIntervalS) * (i + 1);
+            double dataRequired = playedS * m_config.bitrate / 8 / 1024;
+            int64_t subpieceNum = static_cast<int64_t>(std::ceil(dataRequired));
+            if (static_cast<uint64_t>(subpieceNum) > m_result.uniquePieces)
+            {
+                return Fail("not receive enough data");
+            }
+            auto itor = std::lower_bound(recvTs.begin(), recvTs.end(), std::make_pair(subpieceNum - 1,
+                    -std::numeric_limits<double>::infinity()));
+            if (itor == recvTs.end() || itor->first != subpieceNum - 1)
+            {
+                return Fail("piece " + std::to_string(subpieceNum - 1) + " not received");
+            }
+            tSum += std::max(0.0, (itor->second - m_result.startTs) / 1e6 - playedS);
+        }
+
+        m_result.stallTime = tSum;
+        m_result.alpha = (ds * 1024 + fs) / (2 * fs);
+        m_result.beta = tSum / t;
+        m_result.score = std::round(fs / ((m_result.alpha + m_result.beta) * t) * 1e10) / 1e10;
+        return m_result;
+    }
+
+private:
+    static constexpr double kNotReceived = std::numeric_limits<double>::infinity();
+    static constexpr int64_t kMaxDensePiece = int64_t(1) << 26;
+
+    double& FirstRecv(int64_t piece)
+    {
+        if (piece < 0 || piece >= kMaxDensePiece)
+        {
+            return m_sparseRecv.emplace(piece, double(kNotReceived)).first->second;
+        }
+        if (static_cast<size_t>(piece) >= m_denseRecv.size())
+        {
+            m_denseRecv.resize(std::max<size_t>(piece + 1, m_denseRecv.size() * 2), double(kNotReceived));
+        }
+        return m_denseRecv[piece];
+    }
+
+    ScoreResult Fail(const std::string& status)
+    {
+        m_result.status = status;
+        m_result.score = 0;
+        return m_result;
+    }
+
+    ScoreConfig m_config;
+    ScoreResult m_result;
+    int64_t m_lowestTxPiece{ 0 };
+    std::vector<double> m_denseRecv;/** first receive time by piece number*/
+    std::map<int64_t, double> m_sparseRecv;/** pieces out of the dense range, not expected in practice*/
+};
+
+/**
+ * @brief score a trace log the way get_score.py does. The file is memory mapped and scanned line by line,
+ *        the first '{...}' of each line is taken as a record.
+ * @return false if the file can't be read, with the reason in result.status
+ */
+inline bool ScoreTraceFile(const std::string& path, const ScoreConfig& config, ScoreResult& result)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        result = ScoreResult();
+        result.status = "can't open " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        result = ScoreResult();
+        result.status = "can't stat " + path;
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    const char* data = nullptr;
+    if (size > 0)
+    {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            close(fd);
+            result = ScoreResult();
+            result.status = "can't map " + path;
+            return false;
+        }
+        madvise(addr, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(addr);
+    }
+    close(fd);
+
+    TraceScorer scorer(config);
+    TraceRecord record;
+    const char* end = data + size;
+    for (const char* line = data; line < end;)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!lineEnd)
+        {
+            lineEnd = end;
+        }
+        const char* lbrace = static_cast<const char*>(memchr(line, '{', lineEnd - line));
+        if (lbrace)
+        {
+            const char* rbrace = static_cast<const char*>(memchr(lbrace, '}', lineEnd - lbrace));
+            if (rbrace)
+            {
+                if (TraceRecordParser::Parse(lbrace, rbrace + 1, record))
+                {
+                    scorer.Add(record);
+                }
+                else
+                {
+                    scorer.AddMalformedLine();
+                }
+            }
+        }
+        line = lineEnd + 1;
+    }
+    if (size > 0)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+    result = scorer.Finish();
+    return true;
+}